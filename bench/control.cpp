@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const size_t DEFAULT_CLIENTS{ 8 };
+const size_t DEFAULT_REQUESTS{ 10000 };
+const std::string DEFAULT_COMMAND{ "STATUS 1" };
+}
+
+/// Measures the command throughput of a running bot: every client connects to the control
+/// socket and sends its requests one at a time, each waiting for the reply to the previous
+/// one. Run it against the bot with different io.threads settings to compare them.
+/// Usage: bench_control <socket> [clients] [requests per client] [command]
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket> [clients] [requests per client] [command]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string path(argv[1]);
+    size_t clients = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : DEFAULT_CLIENTS);
+    size_t requests = (argc > 3 ? std::strtoul(argv[3], nullptr, 10) : DEFAULT_REQUESTS);
+    std::string request = (argc > 4 ? argv[4] : DEFAULT_COMMAND) + std::string("\n");
+    if (clients == 0 || requests == 0) {
+        std::cerr << "Need at least one client and one request" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    boost::asio::io_service io;
+    std::vector<boost::asio::local::stream_protocol::socket> sockets;
+    for (size_t i = 0; i < clients; i++) {
+        sockets.emplace_back(io);
+        boost::system::error_code error;
+        sockets.back().connect(boost::asio::local::stream_protocol::endpoint(path), error);
+        if (error) {
+            std::cerr << "Failed to connect to " << path << ": " << boost::system::system_error(error).what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::string> lastReply(clients);
+    std::vector<bool> failed(clients, false);
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < clients; i++) {
+        threads.emplace_back([&, i]() {
+            boost::asio::streambuf buffer;
+            boost::system::error_code error;
+            for (size_t n = 0; n < requests && !error; n++) {
+                boost::asio::write(sockets[i], boost::asio::buffer(request), error);
+                if (!error) {
+                    size_t bytes = boost::asio::read_until(sockets[i], buffer, '\n', error);
+                    lastReply[i].assign(boost::asio::buffer_cast<const char*>(buffer.data()), bytes ? bytes - 1 : 0);
+                    buffer.consume(bytes);
+                }
+            }
+            failed[i] = static_cast<bool>(error);
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (size_t i = 0; i < clients; i++) {
+        if (failed[i]) {
+            std::cerr << "Client " << i << " lost its connection" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t total = clients * requests;
+    std::cout << total << " requests from " << clients << " client(s) in " << seconds << "s: " << total / seconds << " requests/s, "
+              << seconds * 1e6 * clients / total << " us per round trip (last reply: " << lastReply[0] << ")" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+#include <build-bot/macros.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+using namespace dsn::build_bot;
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const size_t MACRO_COUNT{ 500 };
+const size_t DEFAULT_ITERATIONS{ 20000 };
+
+/// What Worker::replaceMacros() did before commands were compiled into templates:
+/// one replace_all() over the whole command per defined macro
+void replaceAll(std::string& str, const std::vector<MacroTable::Macro>& own, const MacroTable& table)
+{
+    for (auto& macro : own)
+        boost::algorithm::replace_all(str, "@" + macro.first + "@", macro.second);
+    for (auto& macro : table.macros())
+        boost::algorithm::replace_all(str, "@" + macro.first + "@", macro.second);
+}
+
+double nanoseconds(const Clock::time_point& start, size_t iterations)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+}
+}
+
+/// Expands a typical configure command against a table of 500 macros, once with the old
+/// replace loop and once with a compiled MacroTemplate; fails if the results differ.
+/// Usage: bench_macros [iterations]
+int main(int argc, char** argv)
+{
+    size_t iterations = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : DEFAULT_ITERATIONS);
+    if (iterations == 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    boost::property_tree::ptree macros;
+    for (size_t i = 0; i < MACRO_COUNT; i++)
+        macros.put("MACRO_" + std::to_string(i), "/opt/toolchains/value-" + std::to_string(i));
+
+    auto table = std::make_shared<MacroTable>();
+    if (!table->load(macros))
+        return EXIT_FAILURE;
+
+    std::vector<MacroTable::Macro> own{ MacroTable::Macro("CMAKE_SOURCE_DIRECTORY", "/var/lib/build-bot/ci/demo/f59a3629/repo") };
+    MacroScope scope(table);
+    scope.set(own[0].first, own[0].second);
+
+    const std::string command{ "cmake @CMAKE_SOURCE_DIRECTORY@ -G Ninja -DCMAKE_BUILD_TYPE=Release "
+                               "-DCMAKE_C_COMPILER=@MACRO_3@/bin/cc -DCMAKE_CXX_COMPILER=@MACRO_3@/bin/c++ "
+                               "-DCMAKE_PREFIX_PATH=@MACRO_42@;@MACRO_117@;@MACRO_250@ -DBOOST_ROOT=@MACRO_499@ "
+                               "-DCMAKE_INSTALL_PREFIX=@MACRO_7@ -DWITH_TESTS=ON" };
+
+    std::string expected;
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        expected = command;
+        replaceAll(expected, own, *table);
+    }
+    double replaceLoop = nanoseconds(start, iterations);
+
+    std::string res;
+    std::vector<std::string> undefined;
+    start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        MacroTemplate compiled(command);
+        compiled.expand(scope, res, undefined);
+    }
+    double compileAndExpand = nanoseconds(start, iterations);
+
+    MacroTemplate compiled(command);
+    start = Clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        compiled.expand(scope, res, undefined);
+    double expand = nanoseconds(start, iterations);
+
+    std::cout << MACRO_COUNT << " macros, " << command.size() << " byte command, " << iterations << " iterations\n"
+              << "  replace_all loop:        " << replaceLoop << " ns/command\n"
+              << "  compile + expand:        " << compileAndExpand << " ns/command (" << replaceLoop / compileAndExpand << "x)\n"
+              << "  expand cached template:  " << expand << " ns/command (" << replaceLoop / expand << "x)\n";
+
+    if (!undefined.empty() || res != expected) {
+        std::cerr << "Expansion differs from the replace loop:\n  " << res << "\n  " << expected << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -416,6 +416,24 @@ public:
     explicit set_cmd_line(const string_type &s);
 };
 
+/**
+ * Restricts the child process to a set of CPUs.
+ *
+ * An empty range leaves the inherited CPU affinity untouched.
+ *
+ * \remark <em>POSIX only.</em>
+ */
+class set_cpu_affinity : public initializer_base
+{
+public:
+    /**
+     * Constructor.
+     *
+     * \c range_type must be a range of CPU numbers.
+     */
+    explicit set_cpu_affinity(const range_type &cpus);
+};
+
 /**
  * Sets the environment.
  */
@@ -446,6 +464,22 @@ public:
     explicit set_on_error(boost::system::error_code &ec);
 };
 
+/**
+ * Moves the child process into a process group.
+ *
+ * By default the child becomes the leader of a new process group.
+ *
+ * \remark <em>POSIX only.</em>
+ */
+class set_process_group : public initializer_base
+{
+public:
+    /**
+     * Constructor.
+     */
+    explicit set_process_group(pid_t pgid = 0);
+};
+
 /**
  * Sets the flag \c wShowWindow in \c STARTUPINFO.
  *
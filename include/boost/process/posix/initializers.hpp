@@ -31,8 +31,10 @@
 #include <boost/process/posix/initializers/run_exe.hpp>
 #include <boost/process/posix/initializers/set_args.hpp>
 #include <boost/process/posix/initializers/set_cmd_line.hpp>
+#include <boost/process/posix/initializers/set_cpu_affinity.hpp>
 #include <boost/process/posix/initializers/set_env.hpp>
 #include <boost/process/posix/initializers/set_on_error.hpp>
+#include <boost/process/posix/initializers/set_process_group.hpp>
 #include <boost/process/posix/initializers/start_in_dir.hpp>
 #include <boost/process/posix/initializers/throw_on_error.hpp>
 
@@ -0,0 +1,42 @@
+// Copyright (c) 2015, #das-system Networks
+//
+// Part of build-bot and distributed under its license (see LICENSE). This initializer
+// isn't part of upstream Boost.Process, it only follows the style of the bundled copy.
+
+#ifndef BOOST_PROCESS_POSIX_INITIALIZERS_SET_CPU_AFFINITY_HPP
+#define BOOST_PROCESS_POSIX_INITIALIZERS_SET_CPU_AFFINITY_HPP
+
+#include <boost/process/posix/initializers/initializer_base.hpp>
+#include <sched.h>
+
+namespace boost { namespace process { namespace posix { namespace initializers {
+
+class set_cpu_affinity : public initializer_base
+{
+public:
+    template <class Range>
+    explicit set_cpu_affinity(const Range &cpus) : empty_(true)
+    {
+        CPU_ZERO(&set_);
+        for (typename Range::const_iterator it = cpus.begin(); it != cpus.end(); ++it)
+        {
+            CPU_SET(*it, &set_);
+            empty_ = false;
+        }
+    }
+
+    template <class PosixExecutor>
+    void on_exec_setup(PosixExecutor&) const
+    {
+        if (!empty_)
+            ::sched_setaffinity(0, sizeof(set_), &set_);
+    }
+
+private:
+    cpu_set_t set_;
+    bool empty_;
+};
+
+}}}}
+
+#endif
@@ -0,0 +1,32 @@
+// Copyright (c) 2015, #das-system Networks
+//
+// Part of build-bot and distributed under its license (see LICENSE). This initializer
+// isn't part of upstream Boost.Process, it only follows the style of the bundled copy.
+
+#ifndef BOOST_PROCESS_POSIX_INITIALIZERS_SET_PROCESS_GROUP_HPP
+#define BOOST_PROCESS_POSIX_INITIALIZERS_SET_PROCESS_GROUP_HPP
+
+#include <boost/process/posix/initializers/initializer_base.hpp>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace boost { namespace process { namespace posix { namespace initializers {
+
+class set_process_group : public initializer_base
+{
+public:
+    explicit set_process_group(pid_t pgid = 0) : pgid_(pgid) {}
+
+    template <class PosixExecutor>
+    void on_exec_setup(PosixExecutor&) const
+    {
+        ::setpgid(0, pgid_);
+    }
+
+private:
+    pid_t pgid_;
+};
+
+}}}}
+
+#endif
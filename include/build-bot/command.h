@@ -0,0 +1,62 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_COMMAND_H
+#define BUILD_BOT_COMMAND_H 1
+
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace dsn {
+namespace build_bot {
+    /// A single line of input split into its words.
+    ///
+    /// Parsing doesn't copy or allocate anything: all fields refer to the buffer the
+    /// line was parsed from and are only valid as long as it is. Words are separated
+    /// by exactly one space, just like the requests are written by the hooks. Words
+    /// can't contain spaces, and lines with any other whitespace (tabs, a trailing
+    /// '\r') or with leading, trailing or doubled spaces are rejected.
+    struct Command {
+        enum class Type {
+            Stop,
+            Restart,
+            Reload,
+
+            /// BUILD <repository> <profile> <branch> <revision> [priority]
+            Build,
+
+            /// BUILD_ALL <repository> <branch> <revision> [priority]
+            BuildAll,
+
+            /// BATCH <bytes>, followed by that many bytes of BUILD and BUILD_ALL lines
+            Batch,
+
+            /// STATUS <job id>
+            Status,
+
+            /// CANCEL <job id>
+            Cancel
+        };
+
+        Type type;
+        boost::string_ref repository;
+        boost::string_ref profile;
+        boost::string_ref branch;
+        boost::string_ref revision;
+
+        /// Empty if the request didn't give one
+        boost::string_ref priority;
+
+        /// Size of the payload following a BATCH header
+        size_t length;
+
+        /// Job a STATUS or CANCEL command refers to
+        uint64_t id;
+
+        /// Returns false if the line isn't a known command with the right number of words
+        static bool parse(boost::string_ref line, Command& command);
+    };
+}
+}
+
+#endif // BUILD_BOT_COMMAND_H
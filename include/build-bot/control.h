@@ -0,0 +1,53 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_CONTROL_H
+#define BUILD_BOT_CONTROL_H 1
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <dsnutil/log/base.h>
+
+#include <build-bot/command.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class ControlSocket;
+    }
+
+    /// Unix domain stream socket taking the same commands as the FIFO, answering each
+    /// one with a single line.
+    ///
+    /// Any number of clients may be connected at the same time. Commands of one
+    /// connection are handled in order; a client may send several before reading the
+    /// replies. Replies start with "OK" or "ERROR", followed by the IDs of accepted
+    /// jobs or a description of what went wrong.
+    class ControlSocket : public dsn::log::Base<ControlSocket> {
+    public:
+        /// Sends the reply to a command, without the trailing newline
+        typedef std::function<void(const std::string&)> Reply;
+
+        /// Handles a command (with the payload of a batch), possibly on another thread.
+        /// The command and payload stay valid until the reply has been given.
+        typedef std::function<void(const Command&, boost::string_ref payload, const Reply&)> Handler;
+
+        /// Runs the given read right away, or later if the bot can't take more work now
+        typedef std::function<void(const std::function<void()>&)> Gate;
+
+        ControlSocket(boost::asio::io_service& io, const Handler& handler, const Gate& gate, size_t max_batch);
+        ~ControlSocket();
+
+        /// Binds to the given path, replacing a socket left there by an earlier run
+        bool listen(const std::string& path);
+
+    private:
+        std::unique_ptr<priv::ControlSocket> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_CONTROL_H
@@ -0,0 +1,55 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_CPUSET_H
+#define BUILD_BOT_CPUSET_H 1
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class CpuSetAllocator;
+    }
+
+    /// Partitions the CPUs available to the bot between concurrently running workers.
+    ///
+    /// Every holder of a lease gets an equal, contiguous share of all CPUs, so a lone
+    /// build may use the whole host. Whenever a lease is taken or released the shares
+    /// are recomputed and the holders whose CPUs changed are pinned again. Each share
+    /// has at least slot_cores CPUs; only if that's more than the host has for all
+    /// holders the shares overlap.
+    class CpuSetAllocator : public dsn::log::Base<CpuSetAllocator> {
+    public:
+        typedef std::vector<int> CpuSet;
+        typedef uint64_t Lease;
+
+        /// Applies the CPUs of a lease; called with the allocator's lock held, so it must
+        /// not call back into the allocator
+        typedef std::function<void(const CpuSet&)> Pin;
+
+        CpuSetAllocator(size_t slots, size_t slot_cores);
+        ~CpuSetAllocator();
+
+        /// Takes a new lease; pin is called with its CPUs right away and again whenever
+        /// they change until the lease is released
+        Lease allocate(const Pin& pin);
+
+        /// Takes another lease on the CPUs of the given one, e.g. for a job preempting it.
+        /// The CPUs are only given back once all leases on them are released.
+        Lease share(Lease lease, const Pin& pin);
+
+        void release(Lease lease);
+
+        size_t size() const;
+
+    private:
+        std::unique_ptr<priv::CpuSetAllocator> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_CPUSET_H
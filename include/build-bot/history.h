@@ -0,0 +1,39 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_HISTORY_H
+#define BUILD_BOT_HISTORY_H 1
+
+#include <memory>
+#include <string>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class History;
+    }
+
+    /// Persistent moving averages of per-(repository, profile) build metrics.
+    ///
+    /// Metrics are kept as an exponentially weighted moving average using the
+    /// configured smoothing factor, or as a slowly decaying maximum for peaks that
+    /// are used as an upper bound. Changes are written back by a background thread
+    /// every few seconds; a history file which can't be parsed is discarded.
+    class History : public dsn::log::Base<History> {
+    public:
+        History(const std::string& file, double alpha);
+        ~History();
+
+        bool load();
+
+        void record(const std::string& repository, const std::string& profile, const std::string& metric, double value);
+        void recordPeak(const std::string& repository, const std::string& profile, const std::string& metric, double value);
+        bool estimate(const std::string& repository, const std::string& profile, const std::string& metric, double& value) const;
+
+    private:
+        std::unique_ptr<priv::History> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_HISTORY_H
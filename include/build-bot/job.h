@@ -0,0 +1,93 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_JOB_H
+#define BUILD_BOT_JOB_H 1
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace dsn {
+namespace build_bot {
+    class Worker;
+
+    enum class Stage {
+        Acquire = 0,
+        Configure,
+        Build,
+        Cleanup
+    };
+
+    inline const char* stageName(Stage stage)
+    {
+        switch (stage) {
+        case Stage::Acquire:
+            return "acquire";
+        case Stage::Configure:
+            return "configure";
+        case Stage::Build:
+            return "build";
+        case Stage::Cleanup:
+            return "cleanup";
+        }
+
+        return "unknown";
+    }
+
+    enum class Priority {
+        Low = 0,
+        Normal,
+        High
+    };
+
+    inline const char* priorityName(Priority priority)
+    {
+        switch (priority) {
+        case Priority::Low:
+            return "low";
+        case Priority::Normal:
+            return "normal";
+        case Priority::High:
+            return "high";
+        }
+
+        return "unknown";
+    }
+
+    inline bool priorityFromString(boost::string_ref name, Priority& priority)
+    {
+        for (auto candidate : { Priority::Low, Priority::Normal, Priority::High }) {
+            if (name == priorityName(candidate)) {
+                priority = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// A build request together with the metadata the scheduler needs to order it.
+    struct Job {
+        /// Assigned by the Journal when the job is accepted, 0 before that
+        uint64_t id{ 0 };
+
+        std::shared_ptr<Worker> worker;
+        std::string repository;
+        std::string profile;
+        std::string branch;
+        std::string revision;
+        double weight;
+        Priority priority;
+
+        /// Set if the bot stopped before the job could finish, so it is run again after a restart
+        bool aborted{ false };
+
+        /// Time at which the job entered the queue of its current stage
+        std::chrono::steady_clock::time_point queued;
+    };
+}
+}
+
+#endif // BUILD_BOT_JOB_H
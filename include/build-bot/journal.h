@@ -0,0 +1,67 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_JOURNAL_H
+#define BUILD_BOT_JOURNAL_H 1
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dsnutil/log/base.h>
+
+#include <build-bot/job.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Journal;
+    }
+
+    /// Append-only log of accepted, started, failed and finished jobs.
+    ///
+    /// Every accepted job gets a unique ID and stays in the journal until it is
+    /// finished, so jobs which were queued or running when the bot stopped or
+    /// crashed can be replayed on startup. Records are written by a background
+    /// thread which syncs all records collected since its last write at once. The
+    /// journal is compacted to the accept records of unfinished jobs on load and
+    /// whenever finished jobs make up most of it; the next ID is kept, so IDs are
+    /// never reused.
+    class Journal : public dsn::log::Base<Journal> {
+    public:
+        explicit Journal(const std::string& file);
+        ~Journal();
+
+        /// Reads the journal and returns all jobs which haven't finished yet (without
+        /// workers) in the order they were accepted
+        bool load(std::vector<Job>& pending);
+
+        /// Waits until everything recorded so far is on disk
+        void sync();
+
+        /// Writes everything recorded so far and ends the writer thread. Records made
+        /// afterwards are never written, so a process image which is about to be
+        /// replaced can't leave a torn record behind.
+        void stop();
+
+        /// Calls done once everything recorded so far is on disk, from the writer thread
+        /// or right away if nothing is pending. done gets false if the write failed or the
+        /// journal was stopped first.
+        void whenSynced(const std::function<void(bool)>& done);
+
+        /// Assigns a new ID to the given job and records it
+        void accept(Job& job);
+
+        /// Assigns IDs to all given jobs and records them with a single write
+        void accept(std::vector<Job>& jobs);
+
+        void started(const Job& job, Stage stage);
+        void failed(const Job& job, Stage stage);
+        void finished(const Job& job);
+
+    private:
+        std::unique_ptr<priv::Journal> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_JOURNAL_H
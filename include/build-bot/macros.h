@@ -0,0 +1,99 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_MACROS_H
+#define BUILD_BOT_MACROS_H 1
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class MacroTable;
+    }
+
+    /// The macros of a configuration snapshot, loaded once when it is read.
+    ///
+    /// The table isn't changed after load(), so all workers created from the snapshot
+    /// share it. Lookups by name don't allocate.
+    class MacroTable : public dsn::log::Base<MacroTable> {
+    public:
+        typedef std::pair<std::string, std::string> Macro;
+
+        MacroTable();
+        ~MacroTable();
+
+        /// Takes the top-level keys of macros.conf; sections are ignored with a warning
+        bool load(const boost::property_tree::ptree& macros);
+
+        /// Returns nullptr for undefined macros
+        const std::string* find(boost::string_ref name) const;
+
+        /// All macros in the order of the file
+        const std::vector<Macro>& macros() const;
+
+    private:
+        std::unique_ptr<priv::MacroTable> m_impl;
+    };
+
+    /// Macros of a single build: a few of its own, such as CMAKE_SOURCE_DIRECTORY, on top
+    /// of the shared table. Copying a scope doesn't copy the table.
+    class MacroScope {
+    public:
+        explicit MacroScope(const std::shared_ptr<const MacroTable>& table);
+
+        /// Defines or replaces a macro of this scope; the table is left alone
+        void set(const std::string& name, const std::string& value);
+
+        /// Macros of this scope shadow the ones of the table
+        const std::string* find(boost::string_ref name) const;
+
+    private:
+        const std::string* own(boost::string_ref name) const;
+
+        std::shared_ptr<const MacroTable> m_table;
+
+        /// Only a handful of entries, a linear search is fastest
+        std::vector<MacroTable::Macro> m_own;
+    };
+
+    /// A command line with @MACRO@ references, split once into literal text and macro
+    /// names so it can be expanded in a single pass.
+    ///
+    /// Macro names consist of letters, digits, '_', '-' and '.'; an '@' which doesn't start
+    /// such a reference is kept as it is. Values are inserted verbatim, so a value which
+    /// contains a reference itself isn't expanded again.
+    class MacroTemplate {
+    public:
+        explicit MacroTemplate(const std::string& text);
+
+        const std::string& text() const;
+
+        /// Replaces res with the expansion of the template. Names of undefined macros are
+        /// added to undefined, in which case res is left alone and false is returned.
+        bool expand(const MacroScope& macros, std::string& res, std::vector<std::string>& undefined) const;
+
+    private:
+        struct Segment {
+            size_t offset;
+            size_t length;
+            bool macro;
+        };
+
+        static bool isNameCharacter(char c);
+
+        std::string m_text;
+        std::vector<Segment> m_segments;
+        size_t m_literalLength;
+        size_t m_macroCount;
+    };
+}
+}
+
+#endif // BUILD_BOT_MACROS_H
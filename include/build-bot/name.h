@@ -0,0 +1,30 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_NAME_H
+#define BUILD_BOT_NAME_H 1
+
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_ref.hpp>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        /// Hashes names given as std::string and as boost::string_ref alike, so maps keyed by
+        /// std::string can be searched without building a std::string for the key
+        struct NameHash {
+            size_t operator()(boost::string_ref name) const
+            {
+                return boost::hash_range(name.begin(), name.end());
+            }
+        };
+
+        struct NameEqual {
+            bool operator()(boost::string_ref lhs, boost::string_ref rhs) const
+            {
+                return lhs == rhs;
+            }
+        };
+    }
+}
+}
+
+#endif // BUILD_BOT_NAME_H
@@ -0,0 +1,101 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_PIPELINE_H
+#define BUILD_BOT_PIPELINE_H 1
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <dsnutil/log/base.h>
+
+#include <build-bot/job.h>
+
+namespace dsn {
+namespace build_bot {
+    class CpuSetAllocator;
+    class Journal;
+    class Scheduler;
+
+    namespace priv {
+        class Pipeline;
+    }
+
+    /// Moves workers through the acquire -> configure -> build -> cleanup stages.
+    ///
+    /// Every stage has its own queue and its own number of slots so that I/O bound
+    /// checkouts don't compete with CPU bound compiles for the same threads. Workers
+    /// failing in any stage are handed straight to the cleanup stage. Jobs for
+    /// Worker::ALL_PROFILES are split into one job per profile after acquire. The
+    /// order in which queued jobs leave a stage is decided by the Scheduler. If a
+    /// CpuSetAllocator is given, configure and build run on dedicated CPU sets. If a
+    /// Journal is given, jobs are recorded as started, failed and finished in it;
+    /// jobs dropped by stop() are left unfinished.
+    ///
+    /// If all configure or build slots are busy, a queued job may suspend the process
+    /// group of a running job with lower priority and take over its slot (and CPU
+    /// set) until it leaves the stage.
+    class Pipeline : public dsn::log::Base<Pipeline> {
+    public:
+        typedef dsn::build_bot::Stage Stage;
+
+        struct Limits {
+            size_t acquire;
+            size_t configure;
+            size_t build;
+            size_t cleanup;
+
+            /// Number of jobs per stage which may be suspended at the same time
+            size_t preempt;
+        };
+
+        Pipeline(const Limits& limits, const std::shared_ptr<Scheduler>& scheduler, const std::shared_ptr<CpuSetAllocator>& cpus,
+                 const std::shared_ptr<Journal>& journal);
+        ~Pipeline();
+
+        void enqueue(const Job& job);
+
+        /// Queues a job adopted from a previous process image directly in the given stage
+        void enqueue(const Job& job, Stage stage);
+
+        /// A job past the acquire stage and the process group running its current stage
+        /// (0 if it is only queued)
+        struct Handover {
+            Job job;
+            Stage stage;
+            int childGroup;
+        };
+
+        /// Stops starting jobs in all stages and returns the jobs a new process image has
+        /// to take over. Running children are left alone, except for checkouts. Jobs don't
+        /// move on or reach the journal afterwards, unless the pipeline is stopped.
+        std::vector<Handover> handover();
+        size_t queued(Stage stage) const;
+
+        /// Jobs waiting in all stages but cleanup
+        size_t queued() const;
+
+        /// Stage a job is in and whether it is running there; false if the job isn't in the
+        /// pipeline (anymore)
+        bool find(uint64_t id, Stage& stage, bool& running) const;
+
+        /// Drops a queued job or kills the process group of a running one. The job is
+        /// cleaned up and recorded as finished; jobs in the cleanup stage can't be cancelled.
+        bool cancel(uint64_t id);
+
+        /// Number of jobs suspended for higher priority ones and the total time they lost
+        size_t preemptions() const;
+        double preemptedSeconds() const;
+
+        /// Stops starting jobs, waits up to the given deadline for the running ones and
+        /// kills whatever is still running afterwards. Queued and killed jobs are cleaned
+        /// up but stay unfinished in the journal; returns once cleanup is done.
+        void drain(const std::chrono::seconds& deadline);
+
+        void stop();
+
+    private:
+        std::unique_ptr<priv::Pipeline> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_PIPELINE_H
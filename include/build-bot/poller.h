@@ -0,0 +1,57 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_POLLER_H
+#define BUILD_BOT_POLLER_H 1
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Poller;
+    }
+
+    /// Watches branches of repositories which can't send push hooks.
+    ///
+    /// A background thread runs a single "git ls-remote" per repository for all of
+    /// its branches, at most once per interval and no more than the given number of
+    /// times per minute overall. Refs seen for the first time are only remembered;
+    /// when a known ref has moved the callback is run from the polling thread. The
+    /// new revision is only written to the state file once it has been confirmed,
+    /// so a move which wasn't acted upon is reported again after a restart.
+    class Poller : public dsn::log::Base<Poller> {
+    public:
+        struct Target {
+            std::string repository;
+            std::string url;
+            std::vector<std::string> branches;
+        };
+
+        typedef std::function<void(const std::string& repository, const std::string& branch, const std::string& revision)> Callback;
+
+        Poller(const std::string& state_file, std::chrono::seconds interval, size_t rate, const Callback& moved);
+        ~Poller();
+
+        bool load();
+
+        /// Replaces the polled repositories; refs which are still polled keep their state
+        void configure(const std::vector<Target>& targets);
+
+        bool start();
+        void stop();
+
+        /// Records that a build of the given revision has been queued
+        void confirm(const std::string& repository, const std::string& branch, const std::string& revision);
+
+    private:
+        std::unique_ptr<priv::Poller> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_POLLER_H
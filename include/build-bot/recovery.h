@@ -0,0 +1,52 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_RECOVERY_H
+#define BUILD_BOT_RECOVERY_H 1
+
+#include <sys/types.h>
+
+#include <memory>
+#include <set>
+#include <string>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Recovery;
+    }
+
+    /// Cleans up after a bot which didn't shut down properly.
+    ///
+    /// Every child process group is registered in <build_dir>/.children while it
+    /// runs, so groups which outlived a crashed bot can be found again. Workspaces
+    /// are found by walking <build_dir>/<profile>/<repository>/<build id>. Anything
+    /// not adopted by the current process image is killed and removed by a few
+    /// background threads, so the bot can accept requests in the meantime.
+    class Recovery : public dsn::log::Base<Recovery> {
+    public:
+        Recovery(const std::string& build_dir, size_t threads);
+        ~Recovery();
+
+        /// Lists the workspaces and registered process groups left by earlier runs; has
+        /// to be called before any new workspace is created
+        bool scan();
+
+        /// Starts killing orphaned process groups and removing orphaned workspaces. The
+        /// given workspaces and the process groups registered for them are left alone.
+        void start(const std::set<std::string>& adopted);
+
+        /// Waits for the workspaces currently being removed and skips the rest
+        void stop();
+
+        /// Records a running child process group and the workspace it runs for
+        static bool registerChild(const std::string& build_dir, pid_t group, const std::string& workspace);
+        static void unregisterChild(const std::string& build_dir, pid_t group);
+
+    private:
+        std::unique_ptr<priv::Recovery> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_RECOVERY_H
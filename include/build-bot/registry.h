@@ -0,0 +1,60 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_REGISTRY_H
+#define BUILD_BOT_REGISTRY_H 1
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Registry;
+    }
+
+    /// A repository as configured in repositories.conf
+    struct Repository {
+        std::string name;
+        std::string url;
+
+        /// Path of the build configuration inside the repository
+        std::string config;
+        double weight;
+
+        /// Branches which are watched by the poller
+        std::vector<std::string> poll;
+    };
+
+    /// The repositories of a configuration snapshot, compiled once when it is loaded.
+    ///
+    /// The registry isn't changed after load(), so it can be used from any thread.
+    /// Lookups by name hash the given characters directly and don't allocate.
+    class Registry : public dsn::log::Base<Registry> {
+    public:
+        Registry();
+        ~Registry();
+
+        /// Repositories without URL or config or with a weight that isn't positive are
+        /// left out with an error; returns false if the file can't be used at all
+        bool load(const boost::property_tree::ptree& repositories);
+
+        /// Returns nullptr for unknown repositories
+        const Repository* find(boost::string_ref name) const;
+
+        /// All repositories in the order of the file
+        const std::vector<Repository>& repositories() const;
+
+        static const double DEFAULT_WEIGHT;
+
+    private:
+        std::unique_ptr<priv::Registry> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_REGISTRY_H
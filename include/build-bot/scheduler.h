@@ -0,0 +1,67 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_SCHEDULER_H
+#define BUILD_BOT_SCHEDULER_H 1
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dsnutil/log/base.h>
+
+#include <build-bot/job.h>
+
+namespace dsn {
+namespace build_bot {
+    class History;
+
+    namespace priv {
+        class Scheduler;
+    }
+
+    /// Decides which queued job a pipeline stage dispatches next.
+    ///
+    /// With the fair share policy every repository accumulates the slot-seconds its
+    /// jobs used, decaying with the configured half-life. The job whose repository
+    /// has the lowest usage relative to its weight is dispatched first.
+    ///
+    /// The shortest job first policy dispatches the job with the smallest expected
+    /// remaining run time according to the History, minus an aging term of the
+    /// time it has been waiting so long builds can't be starved.
+    ///
+    /// With a memory budget the build stage only starts a job if its predicted
+    /// peak memory still fits next to the reservations of the running builds.
+    /// Lower ranked jobs which fit may start in front of a delayed one until it
+    /// has been waiting for the backfill limit; after that the stage waits for it.
+    class Scheduler : public dsn::log::Base<Scheduler> {
+    public:
+        enum class Policy {
+            Fifo = 0,
+            FairShare,
+            ShortestJobFirst
+        };
+
+        typedef std::chrono::steady_clock Clock;
+
+        Scheduler(Policy policy, const std::chrono::seconds& half_life, const std::shared_ptr<History>& history, double aging,
+                  size_t memory_budget, const std::chrono::seconds& backfill_limit);
+        ~Scheduler();
+
+        /// Positions of the queued jobs in the order they should be dispatched
+        std::vector<size_t> rank(const std::deque<Job>& queue, Stage stage);
+        bool backfill(const Job& blocked);
+        bool reserve(const Job& job, Stage stage);
+        void release(const Job& job, Stage stage);
+        void started(const Job& job, Stage stage, const Clock::time_point& start);
+        void finished(const Job& job, Stage stage, const Clock::time_point& start, bool success);
+
+        static bool policyFromString(const std::string& name, Policy& policy);
+
+    private:
+        std::unique_ptr<priv::Scheduler> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_SCHEDULER_H
@@ -0,0 +1,43 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_WATCHER_H
+#define BUILD_BOT_WATCHER_H 1
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <dsnutil/log/base.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class FileWatcher;
+    }
+
+    /// Calls back on the given strand whenever one of the watched files is written or
+    /// replaced.
+    ///
+    /// The directories containing the files are watched with inotify, so files
+    /// which are replaced by renaming a new version over them (as most editors do)
+    /// are still noticed.
+    class FileWatcher : public dsn::log::Base<FileWatcher> {
+    public:
+        typedef std::function<void()> Callback;
+
+        FileWatcher(boost::asio::io_service& io, boost::asio::io_service::strand& strand, const Callback& changed);
+        ~FileWatcher();
+
+        /// Replaces the set of watched files
+        bool watch(const std::vector<std::string>& files);
+
+    private:
+        std::unique_ptr<priv::FileWatcher> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_WATCHER_H
@@ -0,0 +1,54 @@
+// -*- C++ -*-
+#ifndef BUILD_BOT_WEBHOOK_H
+#define BUILD_BOT_WEBHOOK_H 1
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include <dsnutil/log/base.h>
+
+#include <build-bot/control.h>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Webhook;
+    }
+
+    /// Minimal HTTP/1.1 server taking push events as sent by Gitea, GitHub or GitLab.
+    ///
+    /// Requests are POSTs with a JSON body and a Content-Length; the path is ignored.
+    /// Pushes to branches are handed to the handler, everything else (tags, deleted
+    /// branches, pings) is acknowledged without doing anything. There is no
+    /// authentication, so the listener should only be reachable from trusted hosts.
+    class Webhook : public dsn::log::Base<Webhook> {
+    public:
+        /// What a push event tells about the new head of a branch
+        struct Push {
+            /// Every URL the event gives for the repository, to be matched against the
+            /// configured ones
+            std::vector<std::string> urls;
+            std::string branch;
+            std::string revision;
+        };
+
+        /// Queues the builds for a push, possibly on another thread, and replies with
+        /// "OK <id>..." or "ERROR <reason>"
+        typedef std::function<void(const Push&, const ControlSocket::Reply&)> Handler;
+
+        Webhook(boost::asio::io_service& io, const Handler& handler, const ControlSocket::Gate& gate, size_t max_body);
+        ~Webhook();
+
+        bool listen(const std::string& address, unsigned short port);
+
+    private:
+        std::unique_ptr<priv::Webhook> m_impl;
+    };
+}
+}
+
+#endif // BUILD_BOT_WEBHOOK_H
@@ -3,8 +3,14 @@
 #define BUILD_BOT_WORKER_H 1
 
 #include <memory>
+#include <string>
+#include <vector>
+
+
 #include <dsnutil/log/base.h>
 
+#include <build-bot/macros.h>
+
 namespace dsn {
 namespace build_bot {
     namespace priv {
@@ -12,13 +18,64 @@ namespace build_bot {
     }
     class Worker : public dsn::log::Base<Worker> {
     public:
-        Worker(const std::string& macro_file, const std::string& build_directory, const std::string& repo_name,
+        Worker(const std::shared_ptr<const MacroTable>& macros, const std::string& build_directory, const std::string& repo_name,
                const std::string& url, const std::string& branch, const std::string& revision,
                const std::string& config_file, const std::string& profile_name);
         ~Worker();
-        void run();
+
+        /// Profile name which makes acquire() check out the sources for all profiles of
+        /// the build configuration at once; see split()
+        static const std::string ALL_PROFILES;
+
+        const std::string& profile() const;
+
+        /// Splits an acquired ALL_PROFILES worker into one worker per profile. They share
+        /// the checkout, each has its own binary dir and the last one cleaned up removes
+        /// the checkout.
+        std::vector<std::shared_ptr<Worker> > split();
+
+        /// Pins the children to the given CPUs, including the one running right now
+        void setCpuAffinity(const std::vector<int>& cpus);
+
+        /// Highest summed resident set size (in KiB) of the build command's process group,
+        /// 0 if it hasn't run
+        long peakMemory() const;
+
+        /// Directory holding the checkout and binary dir(s) of this worker's build
+        const std::string& workspace() const;
+        const std::string& binaryDirectory() const;
+
+        /// Process group of the running child, 0 if there is none
+        int childGroup() const;
+
+        /// Kills the process group of the running child and of any child started later
+        void terminate();
+
+        /// While held, a child which exits isn't reaped, so that the next process image can
+        /// still wait for its process group after a RESTART; childGroup() keeps reporting it
+        void hold(bool held);
+
+        /// Continues a build whose workspace was set up by the previous process image.
+        /// If child_group isn't 0 the next configure() or build() waits for that process
+        /// group instead of starting the command again.
+        bool adopt(const std::string& workspace, const std::string& binary_dir, int child_group);
+
+        /// Makes this worker one of the users of the other worker's checkout
+        void shareCheckout(const Worker& other);
+
+        /// Stops the process group of the running child (and any child started later)
+        /// until resume() is called
+        void suspend();
+        void resume();
+
+        bool acquire();
+        bool configure();
+        bool build();
+        void cleanup();
 
     private:
+        explicit Worker(std::unique_ptr<priv::Worker> impl);
+
         std::unique_ptr<priv::Worker> m_impl;
     };
 }
@@ -1,12 +1,33 @@
 #include <build-bot/bot.h>
+#include <build-bot/command.h>
+#include <build-bot/control.h>
+#include <build-bot/cpuset.h>
+#include <build-bot/history.h>
+#include <build-bot/journal.h>
+#include <build-bot/macros.h>
+#include <build-bot/pipeline.h>
+#include <build-bot/poller.h>
+#include <build-bot/recovery.h>
+#include <build-bot/registry.h>
+#include <build-bot/scheduler.h>
 #include <build-bot/worker.h>
 #include <build-bot/version.h>
+#include <build-bot/watcher.h>
+#include <build-bot/webhook.h>
 
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
 #include <thread>
 
 #include <boost/asio.hpp>
@@ -14,11 +35,10 @@
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
-#include <boost/regex.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <dsnutil/log/sinkmanager.h>
 #include <dsnutil/log/util.h>
-#include <dsnutil/threadpool.h>
 
 namespace fs = boost::filesystem;
 using namespace dsn::build_bot;
@@ -26,10 +46,57 @@ using namespace dsn::build_bot;
 namespace dsn {
 namespace build_bot {
     namespace priv {
+        /// Immutable snapshot of the configuration which can be reloaded at runtime
+        struct Configuration {
+            boost::property_tree::ptree settings;
+            dsn::build_bot::Registry repositories;
+            std::shared_ptr<const dsn::build_bot::MacroTable> macros;
+        };
+
+        /// Defaults and limits of an endpoint commands are read from: the priority of build
+        /// requests which don't give one, and how many of them are taken per second (0 for
+        /// no limit). Reads are delayed once the token bucket is empty, so the producer
+        /// blocks just like it does while the pipeline is backed up.
+        struct Channel {
+            std::string name;
+            dsn::build_bot::Priority priority;
+            double rate;
+            double tokens;
+            std::chrono::steady_clock::time_point refilled;
+        };
+
+        /// A FIFO and the state of the batch which is being read from it
+        struct Fifo {
+            Fifo(boost::asio::io_service& io, const std::string& path_, const std::string& handover_, const std::string& input_)
+                : path(path_)
+                , handover(handover_)
+                , input(input_)
+                , stream(io)
+                , batchLength(0)
+                , batchDiscard(false)
+            {
+            }
+
+            std::string path;
+
+            /// Sections of the handover state the descriptor and the unparsed input are passed on in
+            std::string handover;
+            std::string input;
+
+            Channel channel;
+            boost::asio::posix::stream_descriptor stream;
+            boost::asio::streambuf buffer;
+
+            /// Bytes of the current batch which haven't been handled yet; batches larger than
+            /// the limit are read in chunks and dropped without being parsed.
+            size_t batchLength;
+            bool batchDiscard;
+        };
+
         class Bot : public dsn::log::Base<Bot> {
         protected:
+            /// Settings as read on startup
             boost::property_tree::ptree m_settings;
-            boost::property_tree::ptree m_repositories;
 
             severity m_logSeverity;
 
@@ -43,230 +110,1349 @@ namespace build_bot {
                     return false;
                 }
 
-                if (!fs::is_regular_file(path)) {
-                    BOOST_LOG_SEV(log, severity::error) << "Config file " << config_file << " isn't a regular file!";
-                    return false;
+                if (!fs::is_regular_file(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Config file " << config_file << " isn't a regular file!";
+                    return false;
+                }
+
+                try {
+                    boost::property_tree::read_ini(config_file, m_settings);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse config file " << config_file << ": " << ex.what();
+                    return false;
+                }
+
+                m_configFile = config_file;
+
+                return true;
+            }
+
+            /// Reads the priority and rate limit of an endpoint from its section
+            bool readChannel(const boost::property_tree::ptree& section, const std::string& name, Channel& channel)
+            {
+                channel.name = name;
+                channel.priority = dsn::build_bot::Priority::Normal;
+
+                std::string priority = section.get<std::string>("priority", "");
+                if (!priority.empty() && !dsn::build_bot::priorityFromString(priority, channel.priority)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Invalid priority " << priority << " for endpoint " << name;
+                    return false;
+                }
+
+                channel.rate = section.get<double>("rate", 0.0);
+                if (channel.rate < 0.0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Invalid rate " << channel.rate << " for endpoint " << name;
+                    return false;
+                }
+
+                channel.tokens = std::max(channel.rate, 1.0);
+                channel.refilled = std::chrono::steady_clock::now();
+                return true;
+            }
+
+            /// Sections of additional endpoints, named "endpoint:<name>"
+            static std::vector<std::string> endpointSections(const boost::property_tree::ptree& settings)
+            {
+                std::vector<std::string> res;
+                for (auto& section : settings) {
+                    if (section.first.compare(0, ENDPOINT_PREFIX.size(), ENDPOINT_PREFIX) == 0)
+                        res.push_back(section.first);
+                }
+
+                return res;
+            }
+
+            std::vector<std::unique_ptr<Fifo> > m_fifos;
+
+            /// Opens the FIFO from the fifo section and those of all FIFO endpoints
+            bool initFifo()
+            {
+                try {
+                    m_maxBatch = m_settings.get<size_t>("fifo.max_batch", DEFAULT_MAX_BATCH);
+
+                    std::unique_ptr<Fifo> fifo(new Fifo(m_io, m_settings.get<std::string>("fifo.name"), "handover", "input"));
+                    if (!readChannel(m_settings.get_child("fifo"), "fifo", fifo->channel) || !openFifo(*fifo))
+                        return false;
+                    m_fifos.push_back(std::move(fifo));
+
+                    for (auto& name : endpointSections(m_settings)) {
+                        if (name.find_first_not_of(ENDPOINT_NAME_CHARACTERS, ENDPOINT_PREFIX.size()) != std::string::npos) {
+                            BOOST_LOG_SEV(log, severity::error) << "Invalid endpoint name " << name;
+                            return false;
+                        }
+
+                        const auto& section = m_settings.get_child(name);
+                        std::string type = section.get<std::string>("type", "fifo");
+                        if (type != "fifo" && type != "socket") {
+                            BOOST_LOG_SEV(log, severity::error) << "Endpoint " << name << " has unknown type " << type;
+                            return false;
+                        }
+
+                        if (type != "fifo")
+                            continue;
+
+                        fifo.reset(new Fifo(m_io, section.get<std::string>("path"), name, name + ":input"));
+                        if (!readChannel(section, name, fifo->channel) || !openFifo(*fifo))
+                            return false;
+                        m_fifos.push_back(std::move(fifo));
+                    }
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get FIFO settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                return true;
+            }
+
+            /// Creates the FIFO if necessary and opens it, or takes over the descriptor and
+            /// the unparsed input from the previous process image
+            bool openFifo(Fifo& fifo)
+            {
+                fs::path path(fifo.path);
+                if (!fs::exists(path)) {
+                    BOOST_LOG_SEV(log, severity::warning) << "FIFO " << fifo.path << " doesn't exist; trying to create it!";
+                    if (mkfifo(fifo.path.c_str(), 0666) == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to create FIFO " << fifo.path << ": " << strerror(errno);
+                        return false;
+                    }
+                }
+
+                int fd{ -1 };
+                int handoverFd = m_handover.get<int>(fifo.handover + ".fifo", -1);
+                struct stat st;
+                if (handoverFd >= 0 && ::fstat(handoverFd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+                    BOOST_LOG_SEV(log, severity::info) << "Taking over FIFO " << fifo.path << " from previous process image";
+                    fd = handoverFd;
+                }
+
+                BOOST_LOG_SEV(log, severity::debug) << "Opening FIFO " << fifo.path << " for reading.";
+                if (fd == -1 && (fd = open(fifo.path.c_str(), O_RDWR)) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to open FIFO " << fifo.path << " for reading: " << strerror(errno);
+                    return false;
+                }
+
+                boost::system::error_code error = fifo.stream.assign(fd, error);
+                if (error) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to assign FIFO fd to stream_descriptor: " << boost::system::system_error(error).what();
+                    close(fd);
+                    return false;
+                }
+
+                // input is only read once the FIFO is readable, but a read must never block the strand
+                if (fifo.stream.non_blocking(true, error)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to make FIFO " << fifo.path << " non-blocking: " << boost::system::system_error(error).what();
+                    return false;
+                }
+
+                if (fd != handoverFd)
+                    return true;
+
+                // input the previous image had read but not parsed yet goes back into the buffer,
+                // so that a batch it was in the middle of is still handled as one
+                auto input = m_handover.get_child_optional(fifo.input);
+                if (input) {
+                    std::ostream stream(&fifo.buffer);
+                    size_t remaining = input->size();
+                    for (auto& kv : *input) {
+                        stream << kv.second.data();
+                        if (--remaining > 0 || !m_handover.get<bool>(fifo.handover + ".partial", false))
+                            stream << "\n";
+                    }
+                }
+                fifo.batchLength = m_handover.get<size_t>(fifo.handover + ".batch", 0);
+                fifo.batchDiscard = m_handover.get<bool>(fifo.handover + ".discard", false);
+
+                return true;
+            }
+
+            /// Reads the repository and macro configuration named in the given settings into a
+            /// new snapshot; returns nullptr if any of them can't be read.
+            std::shared_ptr<const Configuration> loadConfiguration(const boost::property_tree::ptree& settings)
+            {
+                std::shared_ptr<Configuration> config = std::make_shared<Configuration>();
+                config->settings = settings;
+                config->macros = std::make_shared<dsn::build_bot::MacroTable>();
+
+                std::string repoFile;
+                std::string macroFile;
+                try {
+                    repoFile = settings.get<std::string>("repositories.config", DEFAULT_REPO_CONFIG);
+                    macroFile = settings.get<std::string>("fs.macro_file", DEFAULT_MACRO_FILE);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Unable to get repository config file from settings: " << ex.what();
+                    return nullptr;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Initializing repository configuration from " << repoFile;
+                fs::path path(repoFile);
+                if (!fs::exists(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Repository config file " << repoFile << " doesn't exist!";
+                    return nullptr;
+                }
+
+                if (!fs::is_regular_file(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Repository config " << repoFile << " isn't a regular file!";
+                    return nullptr;
+                }
+
+                boost::property_tree::ptree repositories;
+                try {
+                    boost::property_tree::read_ini(repoFile, repositories);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse repository configuration from " << repoFile << ": " << ex.what();
+                    return nullptr;
+                }
+
+                if (!config->repositories.load(repositories))
+                    return nullptr;
+
+                fs::path macroPath(macroFile);
+                if (!fs::exists(macroPath)) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Macro file " << macroFile << " doesn't exist!";
+                    return config;
+                }
+
+                if (!fs::is_regular_file(macroPath)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Macro configuration " << macroFile << " exists but isn't a regular file!";
+                    return nullptr;
+                }
+
+                boost::property_tree::ptree macros;
+                try {
+                    boost::property_tree::read_ini(macroFile, macros);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse macros from " << macroFile << ": " << ex.what();
+                    return nullptr;
+                }
+
+                std::shared_ptr<dsn::build_bot::MacroTable> table = std::make_shared<dsn::build_bot::MacroTable>();
+                if (!table->load(macros))
+                    return nullptr;
+
+                config->macros = table;
+                return config;
+            }
+
+            /// Current configuration snapshot; only ever replaced as a whole, so a reader
+            /// always sees a consistent one
+            std::shared_ptr<const Configuration> m_config;
+
+            std::shared_ptr<const Configuration> config() const
+            {
+                return std::atomic_load(&m_config);
+            }
+
+            bool initRepositories()
+            {
+                auto config = loadConfiguration(m_settings);
+                if (!config)
+                    return false;
+
+                std::atomic_store(&m_config, config);
+                return true;
+            }
+
+            /// Files whose changes trigger a reload
+            std::vector<std::string> configFiles(const Configuration& config) const
+            {
+                std::vector<std::string> res{ m_configFile };
+                res.push_back(config.settings.get<std::string>("repositories.config", DEFAULT_REPO_CONFIG));
+                res.push_back(config.settings.get<std::string>("fs.macro_file", DEFAULT_MACRO_FILE));
+
+                return res;
+            }
+
+            std::unique_ptr<dsn::build_bot::FileWatcher> m_watcher;
+
+            bool initWatcher()
+            {
+                bool watch{ true };
+                try {
+                    watch = m_settings.get<bool>("reload.watch", DEFAULT_RELOAD_WATCH);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get reload settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                if (!watch)
+                    return true;
+
+                m_watcher.reset(new dsn::build_bot::FileWatcher(m_io, m_strand, [this]() { reload(); }));
+                return m_watcher->watch(configFiles(*config()));
+            }
+
+            /// Publishes a new configuration snapshot. Repositories, macros and the settings used
+            /// for new jobs take effect immediately; jobs which were already accepted keep the
+            /// snapshot they were created with. Sections which shape the bot itself are only
+            /// read on startup, changing them needs a RESTART.
+            bool reload()
+            {
+                BOOST_LOG_SEV(log, severity::info) << "Reloading configuration from " << m_configFile;
+
+                boost::property_tree::ptree settings;
+                try {
+                    boost::property_tree::read_ini(m_configFile, settings);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse config file " << m_configFile << ": " << ex.what() << "; keeping current configuration";
+                    return false;
+                }
+
+                auto config = loadConfiguration(settings);
+                if (!config) {
+                    BOOST_LOG_SEV(log, severity::error) << "Keeping current configuration";
+                    return false;
+                }
+
+                std::vector<std::string> keys = STARTUP_SETTINGS;
+                for (auto& tree : { &m_settings, &settings }) {
+                    for (auto& name : endpointSections(*tree)) {
+                        if (std::find(keys.begin(), keys.end(), name) == keys.end())
+                            keys.push_back(name);
+                    }
+                }
+
+                for (auto& key : keys) {
+                    auto previous = m_settings.get_child_optional(key);
+                    auto current = settings.get_child_optional(key);
+                    if (!previous != !current || (previous && *previous != *current))
+                        BOOST_LOG_SEV(log, severity::warning) << "Changes to " << key << " only take effect after a RESTART";
+                }
+
+                std::atomic_store(&m_config, config);
+                if (m_watcher)
+                    m_watcher->watch(configFiles(*config));
+                if (m_poller)
+                    m_poller->configure(pollTargets(*config));
+
+                BOOST_LOG_SEV(log, severity::info) << "Configuration reloaded; " << config->repositories.repositories().size() << " repositories configured";
+                return true;
+            }
+
+            std::string m_buildDirectory;
+
+            bool initBuildDirectory()
+            {
+                std::string buildDir;
+                try {
+                    buildDir = m_settings.get<std::string>("fs.build_dir");
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Unable to get build directory from configuration: " << ex.what();
+                    return false;
+                }
+
+                fs::path path(buildDir);
+                if (!fs::exists(path)) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Build directory " << buildDir << "doesn't exist; trying to create it!";
+                    try {
+                        boost::filesystem::create_directories(path);
+                    }
+
+                    catch (boost::system::system_error& ex) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to create build directory " << buildDir << ": " << ex.what();
+                        return false;
+                    }
+                }
+
+                if (!fs::is_directory(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Configured build path " << buildDir << " isn't a directory!";
+                    return false;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Build directory is " << buildDir;
+                m_buildDirectory = buildDir;
+
+                return true;
+            }
+
+            std::unique_ptr<dsn::build_bot::Recovery> m_recovery;
+
+            /// Workspaces which were taken over with their jobs and must survive recovery
+            std::set<std::string> m_adoptedWorkspaces;
+
+            /// Only lists what earlier runs left behind; killing and removing it is started
+            /// once the adopted jobs are known.
+            bool initRecovery()
+            {
+                size_t threads{ 0 };
+                try {
+                    threads = m_settings.get<size_t>("recovery.threads", DEFAULT_RECOVERY_THREADS);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get recovery settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                if (threads == 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Recovery needs at least one thread!";
+                    return false;
+                }
+
+                m_recovery.reset(new dsn::build_bot::Recovery(m_buildDirectory, threads));
+                return m_recovery->scan();
+            }
+
+            /// Everything below is only touched by handlers running on m_strand, so the
+            /// io_service may be run by several threads
+            boost::asio::io_service m_io;
+            boost::asio::strand m_strand;
+            size_t m_ioThreads;
+
+            bool initThreads()
+            {
+                try {
+                    m_ioThreads = m_settings.get<size_t>("io.threads", DEFAULT_IO_THREADS);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get I/O settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                if (m_ioThreads == 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "The io_service needs at least one thread!";
+                    return false;
+                }
+
+                return true;
+            }
+
+            /// Webhook connections parse and reply in parallel, only their requests and reads
+            /// are passed through the strand
+            void gate(const std::function<void()>& read)
+            {
+                m_strand.dispatch([this, read]() { whenAccepting(read); });
+            }
+
+            std::atomic<bool> m_stopRequested;
+            std::atomic<bool> m_restartAfterStop;
+
+            std::string m_configFile;
+
+            /// Parses the line in place; the streambuf's input sequence is a single contiguous buffer
+            void read(Fifo* fifo, size_t bytes)
+            {
+                boost::string_ref message(boost::asio::buffer_cast<const char*>(fifo->buffer.data()), bytes - 1);
+                dsn::build_bot::Command command;
+                if (!dsn::build_bot::Command::parse(message, command)) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to parse message from FIFO " << fifo->path << ": " << message;
+                }
+
+                else if (command.type == dsn::build_bot::Command::Type::Batch) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Got BATCH of " << command.length << " byte(s)";
+                    fifo->batchLength = command.length;
+                    if (fifo->batchLength > m_maxBatch) {
+                        BOOST_LOG_SEV(log, severity::error) << "Dropping batch of " << fifo->batchLength << " bytes, the limit is " << m_maxBatch;
+                        fifo->batchDiscard = true;
+                    }
+                }
+
+                // nobody reads replies on the FIFO, errors have been logged already
+                else {
+                    execute(command, boost::string_ref(), fifo->channel);
+                }
+                fifo->buffer.consume(bytes);
+
+                armRead(*fifo);
+            }
+
+            void armRead(Fifo& fifo)
+            {
+                Fifo* ptr = &fifo;
+                limit(fifo.channel, [this, ptr]() { readFifo(*ptr); });
+            }
+
+            /// Handles the next line, or the rest of the batch announced by the last one, once
+            /// it has been read completely
+            void readFifo(Fifo& fifo)
+            {
+                if (fifo.batchLength > 0)
+                    return readBatch(fifo);
+
+                const char* begin = boost::asio::buffer_cast<const char*>(fifo.buffer.data());
+                const char* end = begin + fifo.buffer.size();
+                const char* newline = std::find(begin, end, '\n');
+                if (newline == end)
+                    return waitFifo(fifo, &Bot::readFifo);
+
+                read(&fifo, newline - begin + 1);
+            }
+
+            /// Waits until the FIFO is readable, moves its input into the buffer and continues
+            /// with next. The input is read here rather than by the reactor, so none of it can
+            /// be left in a read which never completes once the io_service is stopped.
+            void waitFifo(Fifo& fifo, void (Bot::*next)(Fifo&))
+            {
+                Fifo* ptr = &fifo;
+                fifo.stream.async_read_some(boost::asio::null_buffers(), m_strand.wrap([this, ptr, next](const boost::system::error_code& error, size_t) {
+                    if (error) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to read from FIFO " << ptr->path << ": " << boost::system::system_error(error).what();
+                        return;
+                    }
+
+                    if (readAvailable(*ptr, FIFO_READ_CHUNK))
+                        (this->*next)(*ptr);
+                }));
+            }
+
+            /// Moves up to limit bytes of the input waiting in the FIFO into its buffer
+            /// without blocking
+            bool readAvailable(Fifo& fifo, size_t limit)
+            {
+                int fd = fifo.stream.native_handle();
+                for (;;) {
+                    int available{ 0 };
+                    if (::ioctl(fd, FIONREAD, &available) == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to query input of FIFO " << fifo.path << ": " << strerror(errno);
+                        return false;
+                    }
+
+                    size_t bytes = std::min(static_cast<size_t>(available), limit);
+                    if (bytes == 0)
+                        return true;
+
+                    ssize_t ret = ::read(fd, boost::asio::buffer_cast<char*>(fifo.buffer.prepare(bytes)), bytes);
+                    if (ret == -1 && errno == EINTR)
+                        continue;
+
+                    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        return true;
+
+                    if (ret <= 0) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to read from FIFO " << fifo.path << ": " << (ret == 0 ? "end of file" : strerror(errno));
+                        return false;
+                    }
+
+                    fifo.buffer.commit(ret);
+                    limit -= ret;
+                }
+            }
+
+            size_t m_maxBatch;
+
+            void readBatch(Fifo& fifo)
+            {
+                if (fifo.batchDiscard) {
+                    size_t dropped = std::min(fifo.batchLength, fifo.buffer.size());
+                    fifo.buffer.consume(dropped);
+                    fifo.batchLength -= dropped;
+                    if (fifo.batchLength == 0) {
+                        fifo.batchDiscard = false;
+                        return armRead(fifo);
+                    }
+
+                    return waitFifo(fifo, &Bot::readBatch);
+                }
+
+                if (fifo.buffer.size() < fifo.batchLength)
+                    return waitFifo(fifo, &Bot::readBatch);
+
+                boost::string_ref payload(boost::asio::buffer_cast<const char*>(fifo.buffer.data()), fifo.batchLength);
+                acceptBatch(payload, fifo.channel);
+                fifo.buffer.consume(fifo.batchLength);
+                fifo.batchLength = 0;
+
+                armRead(fifo);
+            }
+
+            /// Either queues all requests of a batch or none of them; every line has to be a
+            /// valid BUILD or BUILD_ALL request for a known repository. Replies with the IDs
+            /// of all jobs in the order of the requests.
+            std::string acceptBatch(boost::string_ref payload, Channel& channel)
+            {
+                std::vector<dsn::build_bot::Job> jobs;
+                size_t lineNumber{ 0 };
+                for (size_t pos = 0; pos < payload.size();) {
+                    lineNumber++;
+                    size_t length = payload.substr(pos).find('\n');
+                    if (length == boost::string_ref::npos) {
+                        BOOST_LOG_SEV(log, severity::error) << "Rejecting batch: line " << lineNumber << " isn't terminated";
+                        return "ERROR line " + std::to_string(lineNumber) + " isn't terminated";
+                    }
+
+                    boost::string_ref line = payload.substr(pos, length);
+                    pos += length + 1;
+
+                    dsn::build_bot::Command command;
+                    dsn::build_bot::Job job;
+                    if (!dsn::build_bot::Command::parse(line, command)
+                        || (command.type != dsn::build_bot::Command::Type::Build && command.type != dsn::build_bot::Command::Type::BuildAll)
+                        || !jobFromCommand(command, job, channel.priority) || !createWorker(job)) {
+                        BOOST_LOG_SEV(log, severity::error) << "Rejecting batch: invalid request in line " << lineNumber << ": " << line;
+                        return "ERROR invalid request in line " + std::to_string(lineNumber);
+                    }
+
+                    jobs.push_back(job);
+                }
+
+                m_journal->accept(jobs);
+                std::string reply{ "OK" };
+                for (auto& job : jobs) {
+                    m_pipeline->enqueue(job);
+                    reply += " " + std::to_string(job.id);
+                }
+
+                channel.tokens -= jobs.size();
+                BOOST_LOG_SEV(log, severity::info) << "Accepted batch of " << jobs.size() << " build request(s) from " << channel.name;
+                return reply;
+            }
+
+            /// Input is throttled once m_highWatermark jobs are queued, until no more than
+            /// m_lowWatermark are left; 0 disables throttling
+            size_t m_highWatermark;
+            size_t m_lowWatermark;
+            bool m_throttled;
+            std::vector<std::function<void()> > m_pausedReads;
+            boost::asio::steady_timer m_throttleTimer;
+
+            /// Runs the given read now or parks it while the pipeline is too far behind. Blocked
+            /// readers leave requests in the FIFO or socket buffers, so producers block as well.
+            void whenAccepting(const std::function<void()>& read)
+            {
+                if (!m_throttled && (m_highWatermark == 0 || m_pipeline->queued() < m_highWatermark))
+                    return read();
+
+                if (!m_throttled) {
+                    BOOST_LOG_SEV(log, severity::warning) << m_pipeline->queued() << " jobs are queued, pausing input until there are "
+                                                          << m_lowWatermark << " or less";
+                    m_throttled = true;
+                    armThrottleTimer();
+                }
+
+                m_pausedReads.push_back(read);
+            }
+
+            void armThrottleTimer()
+            {
+                m_throttleTimer.expires_from_now(THROTTLE_POLL_INTERVAL);
+                m_throttleTimer.async_wait(m_strand.wrap(boost::bind(&Bot::checkThrottle, this, boost::asio::placeholders::error)));
+            }
+
+            void checkThrottle(const boost::system::error_code& error)
+            {
+                if (error)
+                    return;
+
+                size_t queued = m_pipeline->queued();
+                if (queued > m_lowWatermark)
+                    return armThrottleTimer();
+
+                BOOST_LOG_SEV(log, severity::info) << "Resuming input with " << queued << " queued job(s)";
+                m_throttled = false;
+
+                std::vector<std::function<void()> > reads;
+                reads.swap(m_pausedReads);
+                for (auto& read : reads)
+                    read();
+            }
+
+            /// Delays a read from the channel until its rate limit allows another request,
+            /// then passes it on to whenAccepting()
+            void limit(Channel& channel, const std::function<void()>& read)
+            {
+                if (channel.rate > 0.0) {
+                    auto now = std::chrono::steady_clock::now();
+                    channel.tokens = std::min(std::max(channel.rate, 1.0),
+                        channel.tokens + channel.rate * std::chrono::duration<double>(now - channel.refilled).count());
+                    channel.refilled = now;
+
+                    if (channel.tokens < 1.0) {
+                        auto delay = std::chrono::duration<double>((1.0 - channel.tokens) / channel.rate);
+                        auto timer = std::make_shared<boost::asio::steady_timer>(m_io, std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+                        Channel* ptr = &channel;
+                        timer->async_wait(m_strand.wrap([this, timer, ptr, read](const boost::system::error_code& error) {
+                            if (!error)
+                                limit(*ptr, read);
+                        }));
+                        return;
+                    }
+                }
+
+                whenAccepting(read);
+            }
+
+            /// Channels of the control sockets, which are shared by all of their connections
+            std::vector<std::unique_ptr<Channel> > m_socketChannels;
+            std::vector<std::unique_ptr<dsn::build_bot::ControlSocket> > m_controls;
+
+            /// Control sockets are optional, unlike the FIFO
+            bool initControl()
+            {
+                try {
+                    std::string path = m_settings.get<std::string>("socket.path", "");
+                    if (!path.empty() && !listen(path, m_settings.get_child("socket"), "socket"))
+                        return false;
+
+                    for (auto& name : endpointSections(m_settings)) {
+                        const auto& section = m_settings.get_child(name);
+                        if (section.get<std::string>("type", "fifo") == "socket" && !listen(section.get<std::string>("path"), section, name))
+                            return false;
+                    }
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get control socket settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                return true;
+            }
+
+            bool listen(const std::string& path, const boost::property_tree::ptree& section, const std::string& name)
+            {
+                std::unique_ptr<Channel> channel(new Channel);
+                if (!readChannel(section, name, *channel))
+                    return false;
+
+                Channel* ptr = channel.get();
+                m_socketChannels.push_back(std::move(channel));
+
+                std::unique_ptr<dsn::build_bot::ControlSocket> control(new dsn::build_bot::ControlSocket(m_io,
+                    [this, ptr](const dsn::build_bot::Command& command, boost::string_ref payload, const dsn::build_bot::ControlSocket::Reply& reply) {
+                        m_strand.dispatch([this, ptr, command, payload, reply]() { replyCommitted(reply, execute(command, payload, *ptr)); });
+                    },
+                    [this, ptr](const std::function<void()>& read) { m_strand.dispatch([this, ptr, read]() { limit(*ptr, read); }); }, m_maxBatch));
+                if (!control->listen(path))
+                    return false;
+
+                m_controls.push_back(std::move(control));
+                return true;
+            }
+
+            std::unique_ptr<dsn::build_bot::Webhook> m_webhook;
+
+            /// The webhook listener is disabled unless a port is configured
+            bool initWebhook()
+            {
+                std::string address;
+                unsigned short port{ 0 };
+                size_t maxBody{ 0 };
+                try {
+                    address = m_settings.get<std::string>("webhook.address", DEFAULT_WEBHOOK_ADDRESS);
+                    port = m_settings.get<unsigned short>("webhook.port", 0);
+                    maxBody = m_settings.get<size_t>("webhook.max_body", DEFAULT_WEBHOOK_MAX_BODY);
+                }
+
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get webhook settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                if (port == 0)
+                    return true;
+
+                m_webhook.reset(new dsn::build_bot::Webhook(m_io,
+                    [this](const dsn::build_bot::Webhook::Push& push, const dsn::build_bot::ControlSocket::Reply& reply) {
+                        m_strand.dispatch([this, push, reply]() { replyCommitted(reply, pushed(push)); });
+                    },
+                    [this](const std::function<void()>& read) { gate(read); }, maxBody));
+                return m_webhook->listen(address, port);
+            }
+
+            /// Builds all profiles of every configured repository cloned from the pushed one.
+            /// Like a batch, either all of the builds are queued or none.
+            std::string pushed(const dsn::build_bot::Webhook::Push& push)
+            {
+                auto snapshot = config();
+
+                std::vector<dsn::build_bot::Job> jobs;
+                for (auto& repository : snapshot->repositories.repositories()) {
+                    if (std::find(push.urls.begin(), push.urls.end(), repository.url) == push.urls.end())
+                        continue;
+
+                    dsn::build_bot::Job job;
+                    job.priority = dsn::build_bot::Priority::Normal;
+                    job.repository = repository.name;
+                    job.profile = dsn::build_bot::Worker::ALL_PROFILES;
+                    job.branch = push.branch;
+                    job.revision = push.revision;
+                    if (!createWorker(job))
+                        return "ERROR can't build repository " + job.repository;
+
+                    jobs.push_back(job);
                 }
 
-                try {
-                    boost::property_tree::read_ini(config_file, m_settings);
+                if (jobs.empty()) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Ignoring push to " << push.urls.front() << ", no repository is configured for it";
+                    return "ERROR no repository is configured for " + push.urls.front();
                 }
 
-                catch (boost::property_tree::ini_parser_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse config file " << config_file << ": " << ex.what();
-                    return false;
+                m_journal->accept(jobs);
+                std::string reply{ "OK" };
+                for (auto& job : jobs) {
+                    m_pipeline->enqueue(job);
+                    reply += " " + std::to_string(job.id);
                 }
 
-                m_configFile = config_file;
+                BOOST_LOG_SEV(log, severity::info) << "Queued " << jobs.size() << " build(s) of " << push.branch << " at " << push.revision << " for webhook push";
+                return reply;
+            }
 
-                return true;
+            std::unique_ptr<dsn::build_bot::Poller> m_poller;
+
+            /// Repositories with a "poll" key listing the branches to watch
+            std::vector<dsn::build_bot::Poller::Target> pollTargets(const Configuration& config) const
+            {
+                std::vector<dsn::build_bot::Poller::Target> res;
+                for (auto& repository : config.repositories.repositories()) {
+                    if (repository.poll.empty())
+                        continue;
+
+                    dsn::build_bot::Poller::Target target;
+                    target.repository = repository.name;
+                    target.url = repository.url;
+                    target.branches = repository.poll;
+                    res.push_back(target);
+                }
+
+                return res;
             }
 
-            bool initFifo()
+            bool initPoller()
             {
-                std::string fifoName;
+                std::string stateFile;
+                long interval{ 0 };
+                size_t rate{ 0 };
                 try {
-                    fifoName = m_settings.get<std::string>("fifo.name");
+                    stateFile = m_settings.get<std::string>("poll.state_file", DEFAULT_POLL_STATE_FILE);
+                    interval = m_settings.get<long>("poll.interval", DEFAULT_POLL_INTERVAL);
+                    rate = m_settings.get<size_t>("poll.rate", DEFAULT_POLL_RATE);
                 }
 
                 catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to get FIFO settings from configuration: " << ex.what();
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get poller settings from configuration: " << ex.what();
                     return false;
                 }
 
-                fs::path path(fifoName);
-                if (!fs::exists(path)) {
-                    BOOST_LOG_SEV(log, severity::warning) << "FIFO " << fifoName << " doesn't exist; trying to create it!";
-                    if (mkfifo(fifoName.c_str(), 0666) == -1) {
-                        BOOST_LOG_SEV(log, severity::error) << "Failed to create FIFO " << fifoName << ": " << strerror(errno);
-                        return false;
+                if (interval <= 0 || rate == 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Polling needs a positive interval and rate!";
+                    return false;
+                }
+
+                m_poller.reset(new dsn::build_bot::Poller(stateFile, std::chrono::seconds(interval), rate,
+                    [this](const std::string& repository, const std::string& branch, const std::string& revision) {
+                        m_strand.post([this, repository, branch, revision]() { polled(repository, branch, revision); });
+                    }));
+                if (!m_poller->load())
+                    return false;
+
+                m_poller->configure(pollTargets(*config()));
+                return m_poller->start();
+            }
+
+            /// Builds all profiles of a polled branch which has moved
+            void polled(const std::string& repository, const std::string& branch, const std::string& revision)
+            {
+                dsn::build_bot::Job job;
+                job.priority = dsn::build_bot::Priority::Normal;
+                job.repository = repository;
+                job.profile = dsn::build_bot::Worker::ALL_PROFILES;
+                job.branch = branch;
+                job.revision = revision;
+                if (!submit(job))
+                    return;
+
+                m_poller->confirm(repository, branch, revision);
+                BOOST_LOG_SEV(log, severity::info) << "Queued build of " << branch << " at " << revision << " in " << repository << " as job " << job.id;
+            }
+
+            boost::asio::signal_set m_signals;
+
+            /// SIGTERM and SIGINT stop the bot just like the STOP command, SIGHUP restarts it
+            void signal(const boost::system::error_code& error, int signal_number)
+            {
+                if (error) {
+                    if (error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to wait for signals: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Got signal " << signal_number << " (" << strsignal(signal_number) << ")";
+                stop(signal_number == SIGHUP);
+
+                m_signals.async_wait(m_strand.wrap(boost::bind(&Bot::signal, this, boost::asio::placeholders::error, boost::asio::placeholders::signal_number)));
+            }
+
+            /// Sends a reply once the journal records of the jobs it acknowledges are on disk, so
+            /// a crash can't lose a job which has been confirmed already
+            void replyCommitted(const dsn::build_bot::ControlSocket::Reply& reply, const std::string& response)
+            {
+                m_journal->whenSynced([this, reply, response](bool written) {
+                    if (written) {
+                        m_io.post([reply, response]() { reply(response); });
+                        return;
+                    }
+
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to record accepted job(s) in the journal; not acknowledging them";
+                    m_io.post([reply]() { reply("ERROR failed to record job(s) in journal"); });
+                });
+            }
+
+            /// Runs a command from a FIFO or a control connection and returns the reply for
+            /// the latter; the payload is only used by batches.
+            std::string execute(const dsn::build_bot::Command& command, boost::string_ref payload, Channel& channel)
+            {
+                switch (command.type) {
+                case dsn::build_bot::Command::Type::Stop:
+                    BOOST_LOG_SEV(log, severity::info) << "Got STOP command!";
+                    stop();
+                    return "OK";
+
+                case dsn::build_bot::Command::Type::Restart:
+                    BOOST_LOG_SEV(log, severity::info) << "Got RESTART command!";
+                    stop(true);
+                    return "OK";
+
+                case dsn::build_bot::Command::Type::Reload:
+                    BOOST_LOG_SEV(log, severity::info) << "Got RELOAD command!";
+                    reload();
+                    return "OK";
+
+                case dsn::build_bot::Command::Type::Build:
+                    BOOST_LOG_SEV(log, severity::info) << "Got BUILD request for repo=" << command.repository << ", profile=" << command.profile
+                                                       << ", SHA1: " << command.revision;
+                    return enqueueBuild(command, channel);
+
+                case dsn::build_bot::Command::Type::BuildAll:
+                    BOOST_LOG_SEV(log, severity::info) << "Got BUILD_ALL request for repo=" << command.repository << ", SHA1: " << command.revision;
+                    return enqueueBuild(command, channel);
+
+                case dsn::build_bot::Command::Type::Batch:
+                    return acceptBatch(payload, channel);
+
+                case dsn::build_bot::Command::Type::Status:
+                    return status(command.id);
+
+                case dsn::build_bot::Command::Type::Cancel:
+                    if (!m_pipeline->cancel(command.id)) {
+                        BOOST_LOG_SEV(log, severity::warning) << "Can't cancel job " << command.id << ", it isn't queued or running";
+                        return "ERROR job " + std::to_string(command.id) + " isn't queued or running";
                     }
+                    return "OK " + std::to_string(command.id);
                 }
 
-                BOOST_LOG_SEV(log, severity::debug) << "Opening FIFO " << fifoName << " for reading.";
-                int fd{ -1 };
-                if ((fd = open(fifoName.c_str(), O_RDWR)) == -1) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to open FIFO " << fifoName << " for reading: " << strerror(errno);
+                return "ERROR unknown command";
+            }
+
+            /// Finished jobs aren't tracked, so they are as unknown as jobs which never existed
+            std::string status(uint64_t id)
+            {
+                dsn::build_bot::Stage stage;
+                bool running{ false };
+                if (!m_pipeline->find(id, stage, running))
+                    return "ERROR unknown job " + std::to_string(id);
+
+                return "OK " + std::to_string(id) + " " + (running ? "running " : "queued ") + dsn::build_bot::stageName(stage);
+            }
+
+            /// Fills in a job for a BUILD or BUILD_ALL request; requests without a priority get
+            /// the one of the endpoint they came from
+            bool jobFromCommand(const dsn::build_bot::Command& command, dsn::build_bot::Job& job, dsn::build_bot::Priority priority)
+            {
+                job.priority = priority;
+                if (!command.priority.empty() && !dsn::build_bot::priorityFromString(command.priority, job.priority)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Invalid priority in build request: " << command.priority;
                     return false;
                 }
 
-                boost::system::error_code error = m_fifo.assign(fd, error);
-                if (error) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to assign FIFO fd to stream_descriptor: " << boost::system::system_error(error).what();
-                    close(fd);
+                job.repository = command.repository.to_string();
+                if (command.type == dsn::build_bot::Command::Type::BuildAll)
+                    job.profile = dsn::build_bot::Worker::ALL_PROFILES;
+                else
+                    job.profile = command.profile.to_string();
+                job.branch = command.branch.to_string();
+                job.revision = command.revision.to_string();
+                return true;
+            }
+
+            /// Queues a build of the given profile (or of all profiles for BUILD_ALL)
+            std::string enqueueBuild(const dsn::build_bot::Command& command, Channel& channel)
+            {
+                dsn::build_bot::Job job;
+                if (!jobFromCommand(command, job, channel.priority))
+                    return "ERROR invalid priority " + command.priority.to_string();
+
+                if (!submit(job))
+                    return "ERROR can't build repository " + job.repository;
+
+                channel.tokens -= 1.0;
+                return "OK " + std::to_string(job.id);
+            }
+
+            /// Creates the worker for a job from the repository configuration
+            bool createWorker(dsn::build_bot::Job& job)
+            {
+                auto snapshot = config();
+
+                const dsn::build_bot::Repository* repository = snapshot->repositories.find(job.repository);
+                if (!repository) {
+                    BOOST_LOG_SEV(log, severity::error) << "Unknown repository " << job.repository;
                     return false;
                 }
 
+                job.weight = repository->weight;
+                job.worker = std::make_shared<dsn::build_bot::Worker>(snapshot->macros, m_buildDirectory, job.repository, repository->url, job.branch,
+                                                                      job.revision, repository->config, job.profile);
                 return true;
             }
 
-            bool initRepositories()
+            /// Creates the worker for a job and hands it to the pipeline. Jobs which don't have
+            /// an ID yet are recorded in the journal first.
+            bool submit(dsn::build_bot::Job& job)
             {
-                std::string repoFile;
+                if (!createWorker(job))
+                    return false;
+
+                if (job.id == 0)
+                    m_journal->accept(job);
+                m_pipeline->enqueue(job);
+
+                BOOST_LOG_SEV(log, severity::debug) << "Queued " << dsn::build_bot::priorityName(job.priority) << " priority build of " << job.repository
+                                                    << " (" << job.profile << ") as job " << job.id;
+                return true;
+            }
+
+            std::shared_ptr<dsn::build_bot::Journal> m_journal;
+            std::vector<dsn::build_bot::Job> m_unfinished;
+
+            bool initJournal()
+            {
+                std::string journalFile;
                 try {
-                    repoFile = m_settings.get<std::string>("repositories.config", DEFAULT_REPO_CONFIG);
+                    journalFile = m_settings.get<std::string>("journal.file", DEFAULT_JOURNAL_FILE);
                 }
 
                 catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Unable to get repository config file from settings: " << ex.what();
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get job journal settings from configuration: " << ex.what();
                     return false;
                 }
 
-                BOOST_LOG_SEV(log, severity::info) << "Initializing repository configuration from " << repoFile;
-                fs::path path(repoFile);
-                if (!fs::exists(path)) {
-                    BOOST_LOG_SEV(log, severity::error) << "Repository config file " << repoFile << " doesn't exist!";
-                    return false;
+                m_journal = std::make_shared<dsn::build_bot::Journal>(journalFile);
+                return m_journal->load(m_unfinished);
+            }
+
+            /// State handed over by the previous process image on RESTART
+            boost::property_tree::ptree m_handover;
+
+            /// Reads (and removes) the handover file if it was written by this process before execv()
+            bool loadHandover()
+            {
+                std::string handoverFile;
+                try {
+                    handoverFile = m_settings.get<std::string>("handover.file", DEFAULT_HANDOVER_FILE);
                 }
 
-                if (!fs::is_regular_file(path)) {
-                    BOOST_LOG_SEV(log, severity::error) << "Repository config " << repoFile << " isn't a regular file!";
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get handover settings from configuration: " << ex.what();
                     return false;
                 }
 
+                if (!fs::exists(fs::path(handoverFile)))
+                    return true;
+
                 try {
-                    boost::property_tree::read_ini(repoFile, m_repositories);
+                    boost::property_tree::read_ini(handoverFile, m_handover);
                 }
 
                 catch (boost::property_tree::ini_parser_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse repository configuration from " << repoFile << ": " << ex.what();
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to parse handover state from " << handoverFile << ": " << ex.what();
+                    m_handover.clear();
+                }
+
+                boost::system::error_code error;
+                fs::remove(fs::path(handoverFile), error);
+
+                // a left-over file from a crashed process refers to children and descriptors we don't have
+                if (m_handover.get<pid_t>("handover.pid", 0) != getpid()) {
+                    if (!m_handover.empty())
+                        BOOST_LOG_SEV(log, severity::warning) << "Ignoring stale handover state in " << handoverFile;
+                    m_handover.clear();
+                    return true;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Taking over from previous process image (" << (m_handover.size() - 1) << " section(s))";
+                return true;
+            }
+
+            /// Continues a job handed over by the previous image in the stage it was in
+            bool adoptJob(dsn::build_bot::Job& job, const boost::property_tree::ptree& state,
+                          std::map<std::string, std::shared_ptr<dsn::build_bot::Worker> >& checkouts)
+            {
+                int stage = state.get<int>("stage", -1);
+                pid_t childGroup = state.get<pid_t>("child", 0);
+                std::string workspace = state.get<std::string>("workspace", "");
+                std::string binaryDir = state.get<std::string>("binary_dir", "");
+
+                if (stage < static_cast<int>(dsn::build_bot::Stage::Configure) || stage > static_cast<int>(dsn::build_bot::Stage::Cleanup)
+                    || workspace.empty() || !createWorker(job)) {
+                    return false;
+                }
+
+                // the workspace is taken over even if it's incomplete, so it can still be cleaned up
+                bool adopted = job.worker->adopt(workspace, binaryDir, childGroup);
+                if (!adopted && stage != static_cast<int>(dsn::build_bot::Stage::Cleanup)) {
+                    if (childGroup > 0)
+                        ::kill(-childGroup, SIGKILL);
                     return false;
                 }
 
+                // profiles split off the same matrix build keep sharing their checkout
+                auto it = checkouts.find(workspace);
+                if (it != checkouts.end())
+                    job.worker->shareCheckout(*it->second);
+                else
+                    checkouts[workspace] = job.worker;
+                m_adoptedWorkspaces.insert(workspace);
+
+                BOOST_LOG_SEV(log, severity::info) << "Adopted job " << job.id << " for " << job.repository << " (" << job.profile << ") in "
+                                                   << dsn::build_bot::stageName(static_cast<dsn::build_bot::Stage>(stage)) << " stage";
+                m_pipeline->enqueue(job, static_cast<dsn::build_bot::Stage>(stage));
                 return true;
             }
 
-            std::string m_buildDirectory;
+            /// Queues the jobs which were still unfinished when the bot stopped last time;
+            /// jobs handed over by the previous image continue where they were.
+            void replayJournal()
+            {
+                if (m_unfinished.size() > 0)
+                    BOOST_LOG_SEV(log, severity::info) << "Replaying " << m_unfinished.size() << " unfinished job(s) from journal";
+
+                std::map<std::string, std::shared_ptr<dsn::build_bot::Worker> > checkouts;
+                for (auto& job : m_unfinished) {
+                    auto state = m_handover.get_child_optional("job_" + std::to_string(job.id));
+                    if (state && adoptJob(job, *state, checkouts))
+                        continue;
+
+                    if (!submit(job)) {
+                        BOOST_LOG_SEV(log, severity::warning) << "Dropping job " << job.id << " for " << job.repository << " (" << job.profile << ") from journal";
+                        m_journal->finished(job);
+                    }
+                }
 
-            bool initBuildDirectory()
+                m_unfinished.clear();
+            }
+
+            /// Keeps the FIFO open across execv() and passes on a batch which was only partly read,
+            /// together with any input still waiting in the FIFO. Only called once the io
+            /// threads have been joined, so nothing else reads from it anymore.
+            void handoverFifo(Fifo& fifo, boost::property_tree::ptree& state)
             {
-                std::string buildDir;
+                readAvailable(fifo, std::numeric_limits<size_t>::max());
+
+                int fd = fifo.stream.native_handle();
+                int flags = ::fcntl(fd, F_GETFD);
+                if (flags != -1 && ::fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) != -1)
+                    state.put<int>(fifo.handover + ".fifo", fd);
+                else
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to keep FIFO " << fifo.path << " open across restart: " << strerror(errno);
+
+                state.put<size_t>(fifo.handover + ".batch", fifo.batchLength);
+                state.put<bool>(fifo.handover + ".discard", fifo.batchDiscard);
+
+                std::string input(boost::asio::buffer_cast<const char*>(fifo.buffer.data()), fifo.buffer.size());
+                state.put<bool>(fifo.handover + ".partial", !input.empty() && input.back() != '\n');
+
+                std::istringstream stream(input);
+                std::string line;
+                for (size_t i = 0; std::getline(stream, line); i++)
+                    state.put<std::string>(fifo.input + ".line" + std::to_string(i), line);
+            }
+
+            /// Leaves everything the next process image needs to continue in the handover file:
+            /// the FIFO descriptors (which stay open across execv()), all jobs past the acquire
+            /// stage with the process groups running them, and input which wasn't parsed yet.
+            bool handover()
+            {
+                std::string handoverFile;
                 try {
-                    buildDir = m_settings.get<std::string>("fs.build_dir");
+                    handoverFile = m_settings.get<std::string>("handover.file", DEFAULT_HANDOVER_FILE);
                 }
 
                 catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Unable to get build directory from configuration: " << ex.what();
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get handover settings from configuration: " << ex.what();
                     return false;
                 }
 
-                fs::path path(buildDir);
-                if (!fs::exists(path)) {
-                    BOOST_LOG_SEV(log, severity::warning) << "Build directory " << buildDir << "doesn't exist; trying to create it!";
-                    try {
-                        boost::filesystem::create_directories(path);
-                    }
+                boost::property_tree::ptree state;
+                state.put<pid_t>("handover.pid", getpid());
+
+                // no job moves on after the snapshot, and once the journal is stopped nothing
+                // can be half written to it when the process image is replaced
+                for (auto& entry : m_pipeline->handover()) {
+                    boost::property_tree::ptree job;
+                    job.put<int>("stage", static_cast<int>(entry.stage));
+                    job.put<int>("child", entry.childGroup);
+                    job.put<std::string>("workspace", entry.job.worker->workspace());
+                    job.put<std::string>("binary_dir", entry.job.worker->binaryDirectory());
+                    state.add_child("job_" + std::to_string(entry.job.id), job);
+                }
 
-                    catch (boost::system::system_error& ex) {
-                        BOOST_LOG_SEV(log, severity::error) << "Failed to create build directory " << buildDir << ": " << ex.what();
-                        return false;
-                    }
+                m_journal->stop();
+
+                for (auto& fifo : m_fifos)
+                    handoverFifo(*fifo, state);
+
+                try {
+                    boost::property_tree::write_ini(handoverFile, state);
                 }
 
-                if (!fs::is_directory(path)) {
-                    BOOST_LOG_SEV(log, severity::error) << "Configured build path " << buildDir << " isn't a directory!";
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to write handover state to " << handoverFile << ": " << ex.what();
                     return false;
                 }
 
-                BOOST_LOG_SEV(log, severity::info) << "Build directory is " << buildDir;
-                m_buildDirectory = buildDir;
-
                 return true;
             }
 
-            boost::asio::io_service m_io;
-            boost::asio::strand m_strand;
-
-            std::atomic<bool> m_stopRequested;
-            std::atomic<bool> m_restartAfterStop;
-
-            std::string m_configFile;
+            std::unique_ptr<dsn::build_bot::Pipeline> m_pipeline;
+            std::chrono::seconds m_drainTimeout;
 
-            boost::asio::posix::stream_descriptor m_fifo;
-            boost::asio::streambuf m_buffer;
+            std::shared_ptr<dsn::build_bot::History> m_history;
 
-            void read(const boost::system::error_code& error)
+            bool initHistory()
             {
-                if (error) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to read from FIFO: " << boost::system::system_error(error).what();
-                    return;
+                std::string historyFile;
+                double alpha{ 0.0 };
+                try {
+                    historyFile = m_settings.get<std::string>("history.file", DEFAULT_HISTORY_FILE);
+                    alpha = m_settings.get<double>("history.alpha", DEFAULT_HISTORY_ALPHA);
                 }
 
-                std::string message;
-                {
-                    std::istream stream(&m_buffer);
-                    std::getline(stream, message);
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get build history settings from configuration: " << ex.what();
+                    return false;
                 }
 
-                if (!parse(message))
-                    BOOST_LOG_SEV(log, severity::warning) << "Failed to parse message from FIFO: " << message;
+                if (alpha <= 0.0 || alpha > 1.0) {
+                    BOOST_LOG_SEV(log, severity::error) << "History smoothing factor must be in (0, 1], got " << alpha;
+                    return false;
+                }
 
-                boost::asio::async_read_until(m_fifo, m_buffer, "\n", boost::bind(&Bot::read, this, boost::asio::placeholders::error));
+                m_history = std::make_shared<dsn::build_bot::History>(historyFile, alpha);
+                return m_history->load();
             }
 
-            bool parse(const std::string& message)
+            std::shared_ptr<dsn::build_bot::Scheduler> m_scheduler;
+
+            bool initScheduler()
             {
-                if (message == "STOP") {
-                    BOOST_LOG_SEV(log, severity::info) << "Got STOP command on FIFO!";
-                    stop();
-                    return true;
+                std::string policyName;
+                long halfLife{ 0 };
+                double aging{ 0.0 };
+                size_t memoryBudget{ 0 };
+                long backfillLimit{ 0 };
+                try {
+                    policyName = m_settings.get<std::string>("scheduler.policy", DEFAULT_SCHEDULER_POLICY);
+                    halfLife = m_settings.get<long>("scheduler.half_life", DEFAULT_SCHEDULER_HALF_LIFE);
+                    aging = m_settings.get<double>("scheduler.aging", DEFAULT_SCHEDULER_AGING);
+                    memoryBudget = m_settings.get<size_t>("scheduler.memory_budget", DEFAULT_MEMORY_BUDGET);
+                    backfillLimit = m_settings.get<long>("scheduler.backfill_limit", DEFAULT_BACKFILL_LIMIT);
                 }
 
-                if (message == "RESTART") {
-                    BOOST_LOG_SEV(log, severity::info) << "Got RESTART command on FIFO!";
-                    stop(true);
-                    return true;
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get scheduler settings from configuration: " << ex.what();
+                    return false;
+                }
+
+                dsn::build_bot::Scheduler::Policy policy;
+                if (!dsn::build_bot::Scheduler::policyFromString(policyName, policy)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Unknown scheduler policy: " << policyName;
+                    return false;
+                }
+
+                if (halfLife <= 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Scheduler usage half-life must be positive, got " << halfLife;
+                    return false;
+                }
+
+                if (aging < 0.0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Scheduler aging factor must not be negative, got " << aging;
+                    return false;
                 }
 
+                BOOST_LOG_SEV(log, severity::info) << "Scheduler policy is " << policyName << " (usage half-life: " << halfLife << "s)";
+                if (memoryBudget > 0)
+                    BOOST_LOG_SEV(log, severity::info) << "Limiting predicted peak memory of concurrent builds to " << memoryBudget << " MiB";
+
+                m_scheduler = std::make_shared<dsn::build_bot::Scheduler>(policy, std::chrono::seconds(halfLife), m_history, aging, memoryBudget,
+                                                                          std::chrono::seconds(backfillLimit));
+
+                return true;
+            }
+
+            bool initPipeline()
+            {
+                dsn::build_bot::Pipeline::Limits limits;
                 try {
-                    boost::regex BUILD_regex("^BUILD (.+) (.+) (.+) (.+)$");
-                    boost::cmatch match;
-                    if (boost::regex_match(message.c_str(), match, BUILD_regex)) {
-                        std::string repoName(match[1].first, match[1].second);
-                        std::string profileName(match[2].first, match[2].second);
-                        std::string branchName(match[3].first, match[3].second);
-                        std::string gitRevision(match[4].first, match[4].second);
-
-                        BOOST_LOG_SEV(log, severity::info) << "Got BUILD request for repo=" << repoName << ", profile=" << profileName << ", SHA1: " << gitRevision;
-                        std::string repoUrl;
-                        std::string repoConfigFile;
-                        try {
-                            repoUrl = m_repositories.get<std::string>(repoName + ".url");
-                            repoConfigFile = m_repositories.get<std::string>(repoName + ".config");
-                        }
-                        catch (boost::property_tree::ptree_error& ex) {
-                            BOOST_LOG_SEV(log, severity::error) << "Unable to get configuration for repository " << repoName << ": " << ex.what();
-                            return true;
-                        }
+                    limits.acquire = m_settings.get<size_t>("pipeline.acquire_slots", DEFAULT_ACQUIRE_SLOTS);
+                    limits.configure = m_settings.get<size_t>("pipeline.configure_slots", DEFAULT_CONFIGURE_SLOTS);
+                    limits.build = m_settings.get<size_t>("pipeline.build_slots", DEFAULT_BUILD_SLOTS);
+                    limits.cleanup = m_settings.get<size_t>("pipeline.cleanup_slots", DEFAULT_CLEANUP_SLOTS);
+                    limits.preempt = m_settings.get<size_t>("pipeline.preempt_slots", DEFAULT_PREEMPT_SLOTS);
+                    m_drainTimeout = std::chrono::seconds(m_settings.get<long>("pipeline.drain_timeout", DEFAULT_DRAIN_TIMEOUT));
+                    m_highWatermark = m_settings.get<size_t>("pipeline.high_watermark", DEFAULT_HIGH_WATERMARK);
+                    m_lowWatermark = m_settings.get<size_t>("pipeline.low_watermark", DEFAULT_LOW_WATERMARK);
+                }
 
-                        std::string macroFile;
-                        try {
-                            macroFile = m_settings.get<std::string>("fs.macro_file", DEFAULT_MACRO_FILE);
-                        }
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get pipeline settings from configuration: " << ex.what();
+                    return false;
+                }
 
-                        catch (boost::property_tree::ptree_error& ex) {
-                            BOOST_LOG_SEV(log, severity::error) << "Failed to get macro file name from settings: " << ex.what();
-                            return false;
-                        }
+                if (limits.acquire == 0 || limits.configure == 0 || limits.build == 0 || limits.cleanup == 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Every pipeline stage needs at least one slot!";
+                    return false;
+                }
 
-                        m_threadPool.enqueue([=]() {
-			    dsn::build_bot::Worker worker(macroFile, m_buildDirectory, repoName, repoUrl, branchName, gitRevision, repoConfigFile, profileName);
-			    worker.run();
-                        });
+                if (m_highWatermark > 0 && m_lowWatermark >= m_highWatermark) {
+                    BOOST_LOG_SEV(log, severity::error) << "Low watermark (" << m_lowWatermark << ") must be below high watermark (" << m_highWatermark << ")";
+                    return false;
+                }
 
-                        return true;
-                    }
+                if (m_drainTimeout.count() < 0) {
+                    BOOST_LOG_SEV(log, severity::error) << "Drain timeout must not be negative, got " << m_drainTimeout.count();
+                    return false;
+                }
+
+                bool partitionCpus{ false };
+                size_t slotCores{ 0 };
+                try {
+                    partitionCpus = m_settings.get<bool>("cpu.partition", false);
+                    slotCores = m_settings.get<size_t>("cpu.slot_cores", 0);
                 }
 
-                catch (boost::regex_error& ex) {
-                    BOOST_LOG_SEV(log, severity::fatal) << "BUILD regex is malformed: " << ex.what();
+                catch (boost::property_tree::ptree_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get CPU partitioning settings from configuration: " << ex.what();
                     return false;
                 }
 
-                return false;
-            }
+                std::shared_ptr<dsn::build_bot::CpuSetAllocator> cpus;
+                if (partitionCpus)
+                    cpus = std::make_shared<dsn::build_bot::CpuSetAllocator>(limits.configure + limits.build, slotCores);
+
+                BOOST_LOG_SEV(log, severity::info) << "Pipeline slots: acquire=" << limits.acquire << ", configure=" << limits.configure
+                                                   << ", build=" << limits.build << ", cleanup=" << limits.cleanup
+                                                   << ", preempt=" << limits.preempt;
+                m_pipeline.reset(new dsn::build_bot::Pipeline(limits, m_scheduler, cpus, m_journal));
 
-            dsn::ThreadPool m_threadPool;
+                return true;
+            }
 
             bool setupLogging()
             {
@@ -299,18 +1485,26 @@ namespace build_bot {
             Bot()
                 : m_io()
                 , m_strand(m_io)
+                , m_ioThreads(DEFAULT_IO_THREADS)
                 , m_stopRequested(false)
                 , m_restartAfterStop(false)
                 , m_configFile("")
-                , m_fifo(m_io)
+                , m_maxBatch(DEFAULT_MAX_BATCH)
+                , m_highWatermark(DEFAULT_HIGH_WATERMARK)
+                , m_lowWatermark(DEFAULT_LOW_WATERMARK)
+                , m_throttled(false)
+                , m_throttleTimer(m_io)
+                , m_signals(m_io, SIGTERM, SIGINT, SIGHUP)
                 , m_logSeverity(severity::debug)
             {
             }
 
             ~Bot()
             {
-                if (m_fifo.is_open())
-                    m_fifo.close();
+                // the FIFO streams and the watcher's inotify descriptor are declared before
+                // m_io, but have to go before it
+                m_fifos.clear();
+                m_watcher.reset();
             }
 
             bool init(const std::string& config_file)
@@ -327,47 +1521,139 @@ namespace build_bot {
                 if (!initBuildDirectory())
                     return false;
 
+                if (!initRecovery())
+                    return false;
+
+                if (!initHistory())
+                    return false;
+
+                if (!initScheduler())
+                    return false;
+
+                if (!initJournal())
+                    return false;
+
+                if (!initPipeline())
+                    return false;
+
+                if (!loadHandover())
+                    return false;
+
+                replayJournal();
+                m_recovery->start(m_adoptedWorkspaces);
+
+                if (!initThreads())
+                    return false;
+
                 if (!initFifo())
                     return false;
 
+                if (!initControl())
+                    return false;
+
+                if (!initWebhook())
+                    return false;
+
+                if (!initPoller())
+                    return false;
+
+                if (!initWatcher())
+                    return false;
+
+                m_handover.clear();
+
                 return true;
             }
 
+            /// Makes run() return as soon as the handler currently running on the io_service is done
             void stop(bool restart = false)
             {
                 if (restart)
                     m_restartAfterStop = true;
                 m_stopRequested = true;
+                m_io.stop();
             }
 
             dsn::build_bot::Bot::ExitCode run()
             {
                 BOOST_LOG_SEV(log, severity::info) << "build_bot v" << dsn::build_bot::version::MAJOR << "." << dsn::build_bot::version::MINOR
                                                    << "." << dsn::build_bot::version::PATCH << " (" << dsn::build_bot::version::GIT_SHA1 << ") starting up...";
-                BOOST_LOG_SEV(log, severity::trace) << "Installing async read handler for FIFO";
-                boost::asio::async_read_until(m_fifo, m_buffer, "\n", boost::bind(&Bot::read, this, boost::asio::placeholders::error));
-
-                BOOST_LOG_SEV(log, severity::trace) << "Starting io_service";
-                std::thread ioServiceThread([&]() {
-		    m_io.run();
-                });
-
-                while (!m_stopRequested.load()) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                BOOST_LOG_SEV(log, severity::trace) << "Installing async read handlers for " << m_fifos.size() << " FIFO(s)";
+                for (auto& fifo : m_fifos)
+                    armRead(*fifo);
+
+                BOOST_LOG_SEV(log, severity::trace) << "Installing signal handlers";
+                m_signals.async_wait(m_strand.wrap(boost::bind(&Bot::signal, this, boost::asio::placeholders::error, boost::asio::placeholders::signal_number)));
+
+                // stop() may have been called before, io_service::run() would return right away then as well
+                BOOST_LOG_SEV(log, severity::trace) << "Running io_service on " << m_ioThreads << " thread(s)";
+                if (!m_stopRequested.load()) {
+                    std::vector<std::thread> threads;
+                    for (size_t i = 1; i < m_ioThreads; i++)
+                        threads.emplace_back([this]() { m_io.run(); });
+                    m_io.run();
+                    for (auto& thread : threads)
+                        thread.join();
                 }
+                BOOST_LOG_SEV(log, severity::trace) << "io_service stopped";
 
-                BOOST_LOG_SEV(log, severity::trace) << "Stopping io_service";
-                m_io.stop();
-                ioServiceThread.join();
+                if (m_pipeline->preemptions() > 0)
+                    BOOST_LOG_SEV(log, severity::info) << m_pipeline->preemptions() << " preemption(s) have cost suspended jobs "
+                                                       << m_pipeline->preemptedSeconds() << "s in total";
+
+                // orphans which are left are still orphans on the next start
+                m_recovery->stop();
+                m_poller->stop();
 
-                if (m_restartAfterStop.load())
+                if (m_restartAfterStop.load()) {
+                    if (!handover())
+                        BOOST_LOG_SEV(log, severity::warning) << "Restarting without handover; running builds will be repeated";
                     return dsn::build_bot::Bot::ExitCode::Restart;
+                }
+
+                // no new work is accepted while the io_service is stopped
+                m_pipeline->drain(m_drainTimeout);
+                m_journal->sync();
+                BOOST_LOG_SEV(log, severity::info) << "Pipeline drained, shutting down";
 
                 return dsn::build_bot::Bot::ExitCode::Success;
             }
 
             static const std::string DEFAULT_REPO_CONFIG;
             static const std::string DEFAULT_MACRO_FILE;
+
+            static const size_t DEFAULT_ACQUIRE_SLOTS;
+            static const size_t DEFAULT_CONFIGURE_SLOTS;
+            static const size_t DEFAULT_BUILD_SLOTS;
+            static const size_t DEFAULT_CLEANUP_SLOTS;
+            static const size_t DEFAULT_PREEMPT_SLOTS;
+            static const long DEFAULT_DRAIN_TIMEOUT;
+            static const size_t DEFAULT_HIGH_WATERMARK;
+            static const size_t DEFAULT_LOW_WATERMARK;
+            static const std::chrono::milliseconds THROTTLE_POLL_INTERVAL;
+
+            static const std::string DEFAULT_SCHEDULER_POLICY;
+            static const long DEFAULT_SCHEDULER_HALF_LIFE;
+            static const double DEFAULT_SCHEDULER_AGING;
+            static const size_t DEFAULT_MEMORY_BUDGET;
+            static const long DEFAULT_BACKFILL_LIMIT;
+            static const std::string DEFAULT_HISTORY_FILE;
+            static const double DEFAULT_HISTORY_ALPHA;
+            static const std::string DEFAULT_JOURNAL_FILE;
+            static const std::string DEFAULT_HANDOVER_FILE;
+            static const bool DEFAULT_RELOAD_WATCH;
+            static const std::string DEFAULT_POLL_STATE_FILE;
+            static const long DEFAULT_POLL_INTERVAL;
+            static const size_t DEFAULT_POLL_RATE;
+            static const size_t DEFAULT_RECOVERY_THREADS;
+            static const size_t DEFAULT_IO_THREADS;
+            static const size_t DEFAULT_MAX_BATCH;
+            static const std::string DEFAULT_WEBHOOK_ADDRESS;
+            static const size_t DEFAULT_WEBHOOK_MAX_BODY;
+            static const size_t FIFO_READ_CHUNK;
+            static const std::vector<std::string> STARTUP_SETTINGS;
+            static const std::string ENDPOINT_PREFIX;
+            static const std::string ENDPOINT_NAME_CHARACTERS;
         };
     }
 }
@@ -377,6 +1663,40 @@ const std::string dsn::build_bot::Bot::DEFAULT_CONFIG_FILE{ "etc/build-bot/bot.c
 const std::string dsn::build_bot::priv::Bot::DEFAULT_REPO_CONFIG{ "etc/build-bot/repos.conf" };
 const std::string dsn::build_bot::priv::Bot::DEFAULT_MACRO_FILE{ "etc/build-bot/macros.conf" };
 
+const size_t dsn::build_bot::priv::Bot::DEFAULT_ACQUIRE_SLOTS{ 8 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_CONFIGURE_SLOTS{ 4 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_BUILD_SLOTS{ 4 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_CLEANUP_SLOTS{ 2 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_PREEMPT_SLOTS{ 1 };
+const long dsn::build_bot::priv::Bot::DEFAULT_DRAIN_TIMEOUT{ 300 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_HIGH_WATERMARK{ 10000 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_LOW_WATERMARK{ 8000 };
+const std::chrono::milliseconds dsn::build_bot::priv::Bot::THROTTLE_POLL_INTERVAL{ 100 };
+
+const std::string dsn::build_bot::priv::Bot::DEFAULT_SCHEDULER_POLICY{ "fair" };
+const long dsn::build_bot::priv::Bot::DEFAULT_SCHEDULER_HALF_LIFE{ 300 };
+const double dsn::build_bot::priv::Bot::DEFAULT_SCHEDULER_AGING{ 1.0 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_MEMORY_BUDGET{ 0 };
+const long dsn::build_bot::priv::Bot::DEFAULT_BACKFILL_LIMIT{ 600 };
+const std::string dsn::build_bot::priv::Bot::DEFAULT_HISTORY_FILE{ "build_bot.history" };
+const double dsn::build_bot::priv::Bot::DEFAULT_HISTORY_ALPHA{ 0.3 };
+const std::string dsn::build_bot::priv::Bot::DEFAULT_JOURNAL_FILE{ "build_bot.journal" };
+const std::string dsn::build_bot::priv::Bot::DEFAULT_HANDOVER_FILE{ "build_bot.handover" };
+const bool dsn::build_bot::priv::Bot::DEFAULT_RELOAD_WATCH{ true };
+const std::string dsn::build_bot::priv::Bot::DEFAULT_POLL_STATE_FILE{ "build_bot.poll" };
+const long dsn::build_bot::priv::Bot::DEFAULT_POLL_INTERVAL{ 300 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_POLL_RATE{ 10 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_RECOVERY_THREADS{ 2 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_IO_THREADS{ 1 };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_MAX_BATCH{ 1024 * 1024 };
+const std::string dsn::build_bot::priv::Bot::DEFAULT_WEBHOOK_ADDRESS{ "127.0.0.1" };
+const size_t dsn::build_bot::priv::Bot::DEFAULT_WEBHOOK_MAX_BODY{ 1024 * 1024 };
+const size_t dsn::build_bot::priv::Bot::FIFO_READ_CHUNK{ 64 * 1024 };
+const std::vector<std::string> dsn::build_bot::priv::Bot::STARTUP_SETTINGS{ "log", "fifo", "fs.build_dir", "pipeline", "scheduler", "history",
+    "cpu", "journal", "handover", "reload", "recovery", "socket", "webhook", "io", "poll" };
+const std::string dsn::build_bot::priv::Bot::ENDPOINT_PREFIX{ "endpoint:" };
+const std::string dsn::build_bot::priv::Bot::ENDPOINT_NAME_CHARACTERS{ "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-" };
+
 Bot::Bot()
     : m_impl(new priv::Bot())
 {
@@ -0,0 +1,112 @@
+#include <build-bot/command.h>
+
+#include <array>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        /// Splits the line at single spaces into at most N words; returns the number of words
+        /// or N + 1 if there are more. Empty words and whitespace other than the separators
+        /// make the whole line invalid (0), since the words end up in paths and git commands.
+        template <size_t N>
+        size_t split(boost::string_ref line, std::array<boost::string_ref, N>& words)
+        {
+            size_t count{ 0 };
+            size_t start{ 0 };
+            for (size_t pos = 0; pos <= line.size(); pos++) {
+                char c = (pos < line.size() ? line[pos] : ' ');
+                if (c != ' ') {
+                    if (c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f')
+                        return 0;
+                    continue;
+                }
+
+                if (pos == start)
+                    return 0;
+
+                if (count == N)
+                    return N + 1;
+
+                words[count++] = line.substr(start, pos - start);
+                start = pos + 1;
+            }
+
+            return count;
+        }
+
+        /// Parses a decimal number; more digits than that can't be a sensible size or ID
+        /// and might overflow
+        template <typename T>
+        bool number(boost::string_ref word, T& value)
+        {
+            if (word.empty() || word.size() > 18 || word.find_first_not_of("0123456789") != boost::string_ref::npos)
+                return false;
+
+            value = 0;
+            for (char c : word)
+                value = value * 10 + (c - '0');
+            return true;
+        }
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+bool Command::parse(boost::string_ref line, Command& command)
+{
+    std::array<boost::string_ref, 6> words;
+    size_t count = priv::split(line, words);
+    if (count == 0 || count > words.size())
+        return false;
+
+    if (count == 1) {
+        if (words[0] == "STOP")
+            command.type = Type::Stop;
+        else if (words[0] == "RESTART")
+            command.type = Type::Restart;
+        else if (words[0] == "RELOAD")
+            command.type = Type::Reload;
+        else
+            return false;
+
+        return true;
+    }
+
+    if (words[0] == "BUILD" && (count == 5 || count == 6)) {
+        command.type = Type::Build;
+        command.repository = words[1];
+        command.profile = words[2];
+        command.branch = words[3];
+        command.revision = words[4];
+        command.priority = (count == 6 ? words[5] : boost::string_ref());
+        return true;
+    }
+
+    if (words[0] == "BUILD_ALL" && (count == 4 || count == 5)) {
+        command.type = Type::BuildAll;
+        command.repository = words[1];
+        command.profile.clear();
+        command.branch = words[2];
+        command.revision = words[3];
+        command.priority = (count == 5 ? words[4] : boost::string_ref());
+        return true;
+    }
+
+    if (words[0] == "BATCH" && count == 2) {
+        command.type = Type::Batch;
+        return priv::number(words[1], command.length) && command.length > 0;
+    }
+
+    if (words[0] == "STATUS" && count == 2) {
+        command.type = Type::Status;
+        return priv::number(words[1], command.id);
+    }
+
+    if (words[0] == "CANCEL" && count == 2) {
+        command.type = Type::Cancel;
+        return priv::number(words[1], command.id);
+    }
+
+    return false;
+}
@@ -0,0 +1,250 @@
+#include <build-bot/control.h>
+
+#include <fcntl.h>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class ControlSession : public std::enable_shared_from_this<ControlSession>, public dsn::log::Base<ControlSession> {
+        private:
+            boost::asio::local::stream_protocol::socket m_socket;
+            boost::asio::streambuf m_buffer;
+            dsn::build_bot::ControlSocket::Handler m_handler;
+            dsn::build_bot::ControlSocket::Gate m_gate;
+            size_t m_maxBatch;
+
+            /// Size of the batch being read, 0 while reading commands
+            size_t m_batchLength;
+            std::string m_reply;
+
+            /// Commands already buffered wait just like unread ones while the bot is throttled
+            void readLine()
+            {
+                auto self = shared_from_this();
+                m_gate([self]() {
+                    boost::asio::async_read_until(self->m_socket, self->m_buffer, "\n",
+                        boost::bind(&ControlSession::read, self, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+                });
+            }
+
+            void read(const boost::system::error_code& error, size_t bytes)
+            {
+                if (error) {
+                    if (error != boost::asio::error::eof && error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::warning) << "Closing control connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                // the command refers to the buffer, so it is only consumed after handling it
+                boost::string_ref line(boost::asio::buffer_cast<const char*>(m_buffer.data()), bytes - 1);
+                dsn::build_bot::Command command;
+                if (!dsn::build_bot::Command::parse(line, command)) {
+                    m_buffer.consume(bytes);
+                    return send("ERROR malformed command");
+                }
+
+                if (command.type == dsn::build_bot::Command::Type::Batch) {
+                    m_buffer.consume(bytes);
+                    if (command.length > m_maxBatch) {
+                        // the payload can't be skipped without reading it, so the connection is given up
+                        m_reply = "ERROR batch exceeds " + std::to_string(m_maxBatch) + " bytes\n";
+                        boost::asio::async_write(m_socket, boost::asio::buffer(m_reply),
+                            boost::bind(&ControlSession::close, shared_from_this(), boost::asio::placeholders::error));
+                        return;
+                    }
+
+                    m_batchLength = command.length;
+                    return readBatch();
+                }
+
+                auto self = shared_from_this();
+                m_handler(command, boost::string_ref(), [self, bytes](const std::string& reply) {
+                    self->m_buffer.consume(bytes);
+                    self->send(reply);
+                });
+            }
+
+            void readBatch()
+            {
+                if (m_buffer.size() < m_batchLength) {
+                    boost::asio::async_read(m_socket, m_buffer, boost::asio::transfer_exactly(m_batchLength - m_buffer.size()),
+                        boost::bind(&ControlSession::batchRead, shared_from_this(), boost::asio::placeholders::error));
+                    return;
+                }
+
+                dsn::build_bot::Command command;
+                command.type = dsn::build_bot::Command::Type::Batch;
+                command.length = m_batchLength;
+
+                boost::string_ref payload(boost::asio::buffer_cast<const char*>(m_buffer.data()), m_batchLength);
+                auto self = shared_from_this();
+                m_handler(command, payload, [self](const std::string& reply) {
+                    self->m_buffer.consume(self->m_batchLength);
+                    self->m_batchLength = 0;
+                    self->send(reply);
+                });
+            }
+
+            void batchRead(const boost::system::error_code& error)
+            {
+                if (error) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Closing control connection in the middle of a batch: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                readBatch();
+            }
+
+            /// Replies are written one at a time; the next command is read once the reply is out
+            void send(const std::string& reply)
+            {
+                m_reply = reply + "\n";
+                boost::asio::async_write(m_socket, boost::asio::buffer(m_reply),
+                    boost::bind(&ControlSession::written, shared_from_this(), boost::asio::placeholders::error));
+            }
+
+            void written(const boost::system::error_code& error)
+            {
+                if (error) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to reply on control connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                readLine();
+            }
+
+            void close(const boost::system::error_code&)
+            {
+                boost::system::error_code error;
+                m_socket.close(error);
+            }
+
+        public:
+            ControlSession(boost::asio::io_service& io, const dsn::build_bot::ControlSocket::Handler& handler,
+                           const dsn::build_bot::ControlSocket::Gate& gate, size_t max_batch)
+                : m_socket(io)
+                , m_buffer(max_batch + MAX_LINE_LENGTH)
+                , m_handler(handler)
+                , m_gate(gate)
+                , m_maxBatch(max_batch)
+                , m_batchLength(0)
+            {
+            }
+
+            boost::asio::local::stream_protocol::socket& socket()
+            {
+                return m_socket;
+            }
+
+            void start()
+            {
+                readLine();
+            }
+
+            static const size_t MAX_LINE_LENGTH;
+        };
+
+        const size_t ControlSession::MAX_LINE_LENGTH{ 4096 };
+
+        class ControlSocket : public dsn::log::Base<ControlSocket> {
+        private:
+            boost::asio::io_service& m_io;
+            boost::asio::local::stream_protocol::acceptor m_acceptor;
+            dsn::build_bot::ControlSocket::Handler m_handler;
+            dsn::build_bot::ControlSocket::Gate m_gate;
+            size_t m_maxBatch;
+            std::string m_path;
+
+            void accept()
+            {
+                auto session = std::make_shared<ControlSession>(m_io, m_handler, m_gate, m_maxBatch);
+                m_acceptor.async_accept(session->socket(), boost::bind(&ControlSocket::accepted, this, session, boost::asio::placeholders::error));
+            }
+
+            void accepted(std::shared_ptr<ControlSession> session, const boost::system::error_code& error)
+            {
+                if (error) {
+                    if (error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to accept control connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                BOOST_LOG_SEV(log, severity::trace) << "Accepted control connection";
+                ::fcntl(session->socket().native_handle(), F_SETFD, FD_CLOEXEC);
+                session->start();
+                accept();
+            }
+
+        public:
+            ControlSocket(boost::asio::io_service& io, const dsn::build_bot::ControlSocket::Handler& handler,
+                          const dsn::build_bot::ControlSocket::Gate& gate, size_t max_batch)
+                : m_io(io)
+                , m_acceptor(io)
+                , m_handler(handler)
+                , m_gate(gate)
+                , m_maxBatch(max_batch)
+            {
+            }
+
+            ~ControlSocket()
+            {
+                if (!m_acceptor.is_open())
+                    return;
+
+                boost::system::error_code error;
+                m_acceptor.close(error);
+                fs::remove(fs::path(m_path), error);
+            }
+
+            bool listen(const std::string& path)
+            {
+                boost::system::error_code error;
+                if (fs::status(fs::path(path), error).type() == fs::socket_file) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Removing stale control socket " << path;
+                    fs::remove(fs::path(path), error);
+                }
+
+                try {
+                    boost::asio::local::stream_protocol::endpoint endpoint(path);
+                    m_acceptor.open(endpoint.protocol());
+                    ::fcntl(m_acceptor.native_handle(), F_SETFD, FD_CLOEXEC);
+                    m_acceptor.bind(endpoint);
+                    m_acceptor.listen();
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to listen on control socket " << path << ": " << ex.what();
+                    return false;
+                }
+
+                m_path = path;
+                BOOST_LOG_SEV(log, severity::info) << "Listening on control socket " << path;
+                accept();
+                return true;
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+ControlSocket::ControlSocket(boost::asio::io_service& io, const Handler& handler, const Gate& gate, size_t max_batch)
+    : m_impl(new priv::ControlSocket(io, handler, gate, max_batch))
+{
+}
+
+ControlSocket::~ControlSocket()
+{
+}
+
+bool ControlSocket::listen(const std::string& path)
+{
+    return m_impl->listen(path);
+}
@@ -0,0 +1,178 @@
+#include <build-bot/cpuset.h>
+
+#include <sched.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class CpuSetAllocator : public dsn::log::Base<CpuSetAllocator> {
+        private:
+            /// A CPU set and the leases pinned to it
+            struct Holder {
+                dsn::build_bot::CpuSetAllocator::CpuSet cpus;
+                std::map<dsn::build_bot::CpuSetAllocator::Lease, dsn::build_bot::CpuSetAllocator::Pin> pins;
+            };
+
+            std::vector<int> m_cpus;
+            size_t m_slotCores;
+
+            /// CPU sets by the lease they were allocated for, so earlier holders keep the
+            /// lower CPUs, and the set every lease is pinned to
+            std::map<dsn::build_bot::CpuSetAllocator::Lease, Holder> m_holders;
+            std::map<dsn::build_bot::CpuSetAllocator::Lease, dsn::build_bot::CpuSetAllocator::Lease> m_sets;
+            dsn::build_bot::CpuSetAllocator::Lease m_nextLease;
+            mutable std::mutex m_mutex;
+
+            void detectCpus()
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get CPU affinity of build_bot: " << strerror(errno);
+                    return;
+                }
+
+                for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                    if (CPU_ISSET(cpu, &set))
+                        m_cpus.push_back(cpu);
+                }
+            }
+
+            /// Splits the CPUs into one contiguous share per holder and pins the holders whose
+            /// share has changed
+            void rebalance()
+            {
+                size_t holders = m_holders.size();
+                if (holders == 0 || m_cpus.empty())
+                    return;
+
+                size_t i{ 0 };
+                size_t offset{ 0 };
+                for (auto& kv : m_holders) {
+                    dsn::build_bot::CpuSetAllocator::CpuSet cpus;
+                    if (holders * m_slotCores <= m_cpus.size()) {
+                        size_t count = m_cpus.size() / holders + (i < m_cpus.size() % holders ? 1 : 0);
+                        cpus.assign(m_cpus.begin() + offset, m_cpus.begin() + offset + count);
+                        offset += count;
+                    }
+
+                    else {
+                        // oversubscribed: spread the overlapping shares evenly
+                        size_t first = i * m_cpus.size() / holders;
+                        for (size_t j = 0; j < m_slotCores; j++)
+                            cpus.push_back(m_cpus[(first + j) % m_cpus.size()]);
+                        std::sort(cpus.begin(), cpus.end());
+                    }
+
+                    if (cpus != kv.second.cpus) {
+                        kv.second.cpus = cpus;
+                        for (auto& pin : kv.second.pins)
+                            pin.second(cpus);
+                    }
+                    i++;
+                }
+
+                BOOST_LOG_SEV(log, severity::trace) << "Rebalanced " << m_cpus.size() << " CPU(s) between " << holders << " job(s)";
+            }
+
+        public:
+            CpuSetAllocator(size_t slots, size_t slot_cores)
+                : m_slotCores(slot_cores)
+                , m_nextLease(1)
+            {
+                detectCpus();
+
+                if (m_slotCores == 0)
+                    m_slotCores = std::max<size_t>(1, m_cpus.size() / std::max<size_t>(1, slots));
+                m_slotCores = std::min(m_slotCores, m_cpus.size());
+
+                BOOST_LOG_SEV(log, severity::info) << "Partitioning " << m_cpus.size() << " CPU(s) into sets of at least " << m_slotCores << " core(s)";
+            }
+
+            dsn::build_bot::CpuSetAllocator::Lease allocate(const dsn::build_bot::CpuSetAllocator::Pin& pin)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto lease = m_nextLease++;
+                m_holders[lease].pins[lease] = pin;
+                m_sets[lease] = lease;
+                rebalance();
+
+                return lease;
+            }
+
+            dsn::build_bot::CpuSetAllocator::Lease share(dsn::build_bot::CpuSetAllocator::Lease lease, const dsn::build_bot::CpuSetAllocator::Pin& pin)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto set = m_sets.find(lease);
+                if (set == m_sets.end())
+                    return 0;
+
+                auto res = m_nextLease++;
+                Holder& holder = m_holders[set->second];
+                holder.pins[res] = pin;
+                m_sets[res] = set->second;
+                pin(holder.cpus);
+
+                return res;
+            }
+
+            void release(dsn::build_bot::CpuSetAllocator::Lease lease)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto set = m_sets.find(lease);
+                if (set == m_sets.end())
+                    return;
+
+                auto holder = m_holders.find(set->second);
+                m_sets.erase(set);
+                holder->second.pins.erase(lease);
+                if (holder->second.pins.empty()) {
+                    m_holders.erase(holder);
+                    rebalance();
+                }
+            }
+
+            size_t size() const
+            {
+                return m_cpus.size();
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+CpuSetAllocator::CpuSetAllocator(size_t slots, size_t slot_cores)
+    : m_impl(new priv::CpuSetAllocator(slots, slot_cores))
+{
+}
+
+CpuSetAllocator::~CpuSetAllocator()
+{
+}
+
+CpuSetAllocator::Lease CpuSetAllocator::allocate(const Pin& pin)
+{
+    return m_impl->allocate(pin);
+}
+
+void CpuSetAllocator::release(Lease lease)
+{
+    return m_impl->release(lease);
+}
+
+CpuSetAllocator::Lease CpuSetAllocator::share(Lease lease, const Pin& pin)
+{
+    return m_impl->share(lease, pin);
+}
+
+size_t CpuSetAllocator::size() const
+{
+    return m_impl->size();
+}
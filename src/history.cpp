@@ -0,0 +1,250 @@
+#include <build-bot/history.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class History : public dsn::log::Base<History> {
+        private:
+            std::string m_file;
+            double m_alpha;
+
+            boost::property_tree::ptree m_history;
+            mutable std::mutex m_mutex;
+
+            static boost::property_tree::ptree::path_type key(const std::string& repository, const std::string& profile, const std::string& metric)
+            {
+                return boost::property_tree::ptree::path_type(repository + ":" + profile + "/" + metric, '/');
+            }
+
+            bool m_dirty;
+            bool m_stopping;
+            std::condition_variable m_cond;
+            std::thread m_writer;
+
+            /// Writes a snapshot of the history to a temporary file, syncs it to disk and
+            /// renames it over the old file, so a crash never leaves a truncated history.
+            bool save(const boost::property_tree::ptree& history)
+            {
+                std::ostringstream contents;
+                try {
+                    boost::property_tree::write_ini(contents, history);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to serialize build history: " << ex.what();
+                    return false;
+                }
+
+                std::string tempFile = m_file + ".tmp";
+                int fd = ::open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to open " << tempFile << " for writing: " << strerror(errno);
+                    return false;
+                }
+
+                const std::string data = contents.str();
+                size_t written{ 0 };
+                while (written < data.size()) {
+                    ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+                    if (ret == -1 && errno == EINTR)
+                        continue;
+
+                    if (ret == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to write build history to " << tempFile << ": " << strerror(errno);
+                        ::close(fd);
+                        return false;
+                    }
+
+                    written += ret;
+                }
+
+                if (::fsync(fd) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to sync build history " << tempFile << ": " << strerror(errno);
+                    ::close(fd);
+                    return false;
+                }
+                ::close(fd);
+
+                try {
+                    fs::rename(tempFile, m_file);
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to replace build history " << m_file << ": " << ex.what();
+                    return false;
+                }
+
+                return true;
+            }
+
+            /// Saves changed history at most once per SAVE_INTERVAL, outside of m_mutex so
+            /// dispatch decisions never wait for the disk.
+            void writer()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (;;) {
+                    m_cond.wait_for(lock, SAVE_INTERVAL, [&]() { return m_stopping; });
+
+                    if (m_dirty) {
+                        boost::property_tree::ptree snapshot = m_history;
+                        m_dirty = false;
+
+                        lock.unlock();
+                        save(snapshot);
+                        lock.lock();
+                    }
+
+                    if (m_stopping)
+                        return;
+                }
+            }
+
+        public:
+            History(const std::string& file, double alpha)
+                : m_file(file)
+                , m_alpha(alpha)
+                , m_dirty(false)
+                , m_stopping(false)
+            {
+                m_writer = std::thread(&History::writer, this);
+            }
+
+            ~History()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stopping = true;
+                }
+                m_cond.notify_all();
+                m_writer.join();
+            }
+
+            bool load()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                fs::path path(m_file);
+                if (!fs::exists(path)) {
+                    BOOST_LOG_SEV(log, severity::info) << "Build history " << m_file << " doesn't exist yet; starting without estimates.";
+                    return true;
+                }
+
+                if (!fs::is_regular_file(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Build history " << m_file << " isn't a regular file!";
+                    return false;
+                }
+
+                try {
+                    boost::property_tree::read_ini(m_file, m_history);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to parse build history from " << m_file << ": " << ex.what()
+                                                          << "; starting without estimates.";
+                    m_history.clear();
+                    return true;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Loaded build history for " << m_history.size() << " repository profile(s) from " << m_file;
+                return true;
+            }
+
+            void record(const std::string& repository, const std::string& profile, const std::string& metric, double value)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                auto path = key(repository, profile, metric);
+                auto previous = m_history.get_optional<double>(path);
+                double average = previous ? (m_alpha * value + (1.0 - m_alpha) * *previous) : value;
+                m_history.put<double>(path, average);
+
+                m_dirty = true;
+
+                BOOST_LOG_SEV(log, severity::trace) << "Estimate for " << metric << " of " << repository << " (" << profile << ") is now " << average;
+            }
+
+            /// Keeps the largest value seen, decaying by PEAK_DECAY per sample so the estimate can
+            /// follow profiles that shrink without dropping below a recent spike immediately.
+            void recordPeak(const std::string& repository, const std::string& profile, const std::string& metric, double value)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                auto path = key(repository, profile, metric);
+                auto previous = m_history.get_optional<double>(path);
+                double peak = previous ? std::max(value, PEAK_DECAY * *previous) : value;
+                m_history.put<double>(path, peak);
+
+                m_dirty = true;
+
+                BOOST_LOG_SEV(log, severity::trace) << "Peak estimate for " << metric << " of " << repository << " (" << profile << ") is now " << peak;
+            }
+
+            bool estimate(const std::string& repository, const std::string& profile, const std::string& metric, double& value) const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                auto estimate = m_history.get_optional<double>(key(repository, profile, metric));
+                if (!estimate)
+                    return false;
+
+                value = *estimate;
+                return true;
+            }
+
+            static const double PEAK_DECAY;
+            static const std::chrono::seconds SAVE_INTERVAL;
+        };
+
+        const double History::PEAK_DECAY{ 0.95 };
+        const std::chrono::seconds History::SAVE_INTERVAL{ 5 };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+History::History(const std::string& file, double alpha)
+    : m_impl(new priv::History(file, alpha))
+{
+}
+
+History::~History()
+{
+}
+
+bool History::load()
+{
+    return m_impl->load();
+}
+
+void History::record(const std::string& repository, const std::string& profile, const std::string& metric, double value)
+{
+    return m_impl->record(repository, profile, metric, value);
+}
+
+bool History::estimate(const std::string& repository, const std::string& profile, const std::string& metric, double& value) const
+{
+    return m_impl->estimate(repository, profile, metric, value);
+}
+
+void History::recordPeak(const std::string& repository, const std::string& profile, const std::string& metric, double value)
+{
+    return m_impl->recordPeak(repository, profile, metric, value);
+}
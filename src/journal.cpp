@@ -0,0 +1,470 @@
+#include <build-bot/journal.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Journal : public dsn::log::Base<Journal> {
+        private:
+            std::string m_file;
+            int m_fd;
+
+            /// Accept records of all unfinished jobs by ID
+            std::map<uint64_t, std::string> m_live;
+            uint64_t m_nextId;
+
+            /// Records not written yet and the number of records in the file
+            std::string m_pending;
+            size_t m_pendingRecords;
+            size_t m_records;
+
+            /// Number of records queued and written since the start; whenSynced() callbacks
+            /// wait for the former to reach the latter
+            uint64_t m_queued;
+            uint64_t m_committed;
+            std::multimap<uint64_t, std::function<void(bool)> > m_waiting;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::condition_variable m_idle;
+            bool m_writing;
+            bool m_stopping;
+
+            /// Set once the writer thread has written its last batch
+            bool m_stopped;
+            std::thread m_writer;
+
+            static bool writeAll(int fd, const std::string& data)
+            {
+                size_t written{ 0 };
+                while (written < data.size()) {
+                    ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+                    if (ret == -1 && errno == EINTR)
+                        continue;
+
+                    if (ret == -1)
+                        return false;
+
+                    written += ret;
+                }
+
+                return true;
+            }
+
+            bool append(const std::string& records)
+            {
+                if (m_fd == -1) {
+                    m_fd = ::open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+                    if (m_fd == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to open job journal " << m_file << ": " << strerror(errno);
+                        return false;
+                    }
+                }
+
+                if (!writeAll(m_fd, records)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to append to job journal " << m_file << ": " << strerror(errno);
+                    return false;
+                }
+
+                if (::fdatasync(m_fd) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to sync job journal " << m_file << ": " << strerror(errno);
+                    return false;
+                }
+
+                return true;
+            }
+
+            /// Replaces the journal by the given records the same way History saves itself
+            bool compact(const std::string& records)
+            {
+                std::string tempFile = m_file + ".tmp";
+                int fd = ::open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to open " << tempFile << " for writing: " << strerror(errno);
+                    return false;
+                }
+
+                if (!writeAll(fd, records) || ::fsync(fd) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to write compacted job journal " << tempFile << ": " << strerror(errno);
+                    ::close(fd);
+                    return false;
+                }
+                ::close(fd);
+
+                try {
+                    fs::rename(tempFile, m_file);
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to replace job journal " << m_file << ": " << ex.what();
+                    return false;
+                }
+
+                // further records go to the new file
+                if (m_fd != -1) {
+                    ::close(m_fd);
+                    m_fd = -1;
+                }
+
+                return true;
+            }
+
+            /// Accept records of the unfinished jobs, preceded by the next ID so IDs of
+            /// finished jobs aren't handed out again after compaction
+            std::string liveRecords() const
+            {
+                std::string res = "NEXT " + std::to_string(m_nextId) + "\n";
+                for (auto& kv : m_live)
+                    res += kv.second;
+
+                return res;
+            }
+
+            void record(const std::string& line)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_pending += line;
+                    m_pendingRecords++;
+                    m_queued++;
+                }
+                m_cond.notify_one();
+            }
+
+            /// Writes everything recorded while the previous batch was being synced with a
+            /// single fdatasync(); the journal is compacted once finished jobs dominate it.
+            void writer()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (;;) {
+                    m_cond.wait(lock, [&]() { return m_stopping || !m_pending.empty(); });
+
+                    if (!m_pending.empty()) {
+                        std::string batch;
+                        batch.swap(m_pending);
+                        m_records += m_pendingRecords;
+                        m_pendingRecords = 0;
+                        m_writing = true;
+                        uint64_t sequence = m_queued;
+
+                        lock.unlock();
+                        bool written = append(batch);
+                        lock.lock();
+
+                        m_committed = sequence;
+                        std::vector<std::function<void(bool)> > done;
+                        auto end = m_waiting.upper_bound(m_committed);
+                        for (auto it = m_waiting.begin(); it != end; ++it)
+                            done.push_back(it->second);
+                        m_waiting.erase(m_waiting.begin(), end);
+
+                        if (!done.empty()) {
+                            lock.unlock();
+                            for (auto& callback : done)
+                                callback(written);
+                            lock.lock();
+                        }
+
+                        if (m_records > COMPACT_THRESHOLD && m_records > COMPACT_RATIO * m_live.size()) {
+                            // records still pending are appended to the compacted journal; replaying
+                            // an accept record twice is harmless
+                            std::string snapshot = liveRecords();
+                            m_records = m_live.size();
+
+                            lock.unlock();
+                            BOOST_LOG_SEV(log, severity::debug) << "Compacting job journal " << m_file << " to " << m_records << " record(s)";
+                            compact(snapshot);
+                            lock.lock();
+                        }
+
+                        m_writing = false;
+                        m_idle.notify_all();
+                    }
+
+                    if (m_stopping && m_pending.empty()) {
+                        // nothing can be waited for any more
+                        m_stopped = true;
+                        m_idle.notify_all();
+                        std::multimap<uint64_t, std::function<void(bool)> > waiting;
+                        waiting.swap(m_waiting);
+                        lock.unlock();
+                        for (auto& kv : waiting)
+                            kv.second(false);
+                        return;
+                    }
+                }
+            }
+
+            /// Parses an accept record: ACCEPT <id> <repository> <profile> <branch> <revision> <priority>
+            static bool parseAccept(std::istream& fields, Job& job)
+            {
+                std::string priority;
+                if (!(fields >> job.id >> job.repository >> job.profile >> job.branch >> job.revision >> priority))
+                    return false;
+
+                return dsn::build_bot::priorityFromString(priority, job.priority);
+            }
+
+        public:
+            Journal(const std::string& file)
+                : m_file(file)
+                , m_fd(-1)
+                , m_nextId(1)
+                , m_pendingRecords(0)
+                , m_records(0)
+                , m_queued(0)
+                , m_committed(0)
+                , m_writing(false)
+                , m_stopping(false)
+                , m_stopped(false)
+            {
+                m_writer = std::thread(&Journal::writer, this);
+            }
+
+            ~Journal()
+            {
+                stop();
+
+                if (!m_pending.empty())
+                    BOOST_LOG_SEV(log, severity::warning) << "Dropping " << m_pendingRecords << " job journal record(s) made after it was stopped";
+
+                if (m_fd != -1)
+                    ::close(m_fd);
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stopping = true;
+                }
+                m_cond.notify_all();
+
+                if (m_writer.joinable())
+                    m_writer.join();
+            }
+
+            bool load(std::vector<Job>& pending)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                fs::path path(m_file);
+                if (!fs::exists(path)) {
+                    BOOST_LOG_SEV(log, severity::info) << "Job journal " << m_file << " doesn't exist yet; starting with an empty queue.";
+                    return true;
+                }
+
+                if (!fs::is_regular_file(path)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Job journal " << m_file << " isn't a regular file!";
+                    return false;
+                }
+
+                std::map<uint64_t, Job> jobs;
+                std::ifstream input(m_file);
+                std::string line;
+                size_t lineNumber{ 0 };
+                while (std::getline(input, line)) {
+                    lineNumber++;
+
+                    std::istringstream fields(line);
+                    std::string type;
+                    uint64_t id{ 0 };
+                    fields >> type;
+
+                    Job job;
+                    if (type == "ACCEPT" && parseAccept(fields, job)) {
+                        jobs[job.id] = job;
+                        m_live[job.id] = line + "\n";
+                        id = job.id;
+                    }
+
+                    else if (type == "FINISH" && (fields >> id)) {
+                        jobs.erase(id);
+                        m_live.erase(id);
+                    }
+
+                    else if ((type == "START" || type == "FAIL") && (fields >> id)) {
+                    }
+
+                    else if (type == "NEXT" && (fields >> id)) {
+                        if (id > m_nextId)
+                            m_nextId = id;
+                        continue;
+                    }
+
+                    else {
+                        // most likely the last record of a crashed bot
+                        BOOST_LOG_SEV(log, severity::warning) << "Ignoring malformed record in line " << lineNumber << " of job journal " << m_file;
+                        continue;
+                    }
+
+                    if (id >= m_nextId)
+                        m_nextId = id + 1;
+                }
+
+                for (auto& kv : jobs)
+                    pending.push_back(kv.second);
+
+                BOOST_LOG_SEV(log, severity::info) << "Job journal " << m_file << " has " << pending.size() << " unfinished job(s)";
+
+                m_records = m_live.size();
+                return compact(liveRecords());
+            }
+
+            void sync()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_idle.wait(lock, [&]() { return m_stopped || (m_pending.empty() && !m_writing); });
+            }
+
+            void whenSynced(const std::function<void(bool)>& done)
+            {
+                bool synced;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_committed < m_queued && !m_stopped) {
+                        m_waiting.emplace(m_queued, done);
+                        return;
+                    }
+                    synced = (m_committed == m_queued);
+                }
+
+                done(synced);
+            }
+
+            void accept(Job& job)
+            {
+                std::vector<Job*> jobs{ &job };
+                accept(jobs);
+            }
+
+            /// All records are queued at once, so they end up in the same write
+            void accept(const std::vector<Job*>& jobs)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (auto job : jobs) {
+                        job->id = m_nextId++;
+
+                        std::ostringstream line;
+                        line << "ACCEPT " << job->id << " " << job->repository << " " << job->profile << " " << job->branch << " "
+                             << job->revision << " " << priorityName(job->priority) << "\n";
+                        m_live[job->id] = line.str();
+                        m_pending += line.str();
+                        m_pendingRecords++;
+                        m_queued++;
+                    }
+                }
+                m_cond.notify_one();
+            }
+
+            void started(const Job& job, Stage stage)
+            {
+                std::ostringstream line;
+                line << "START " << job.id << " " << stageName(stage) << "\n";
+                record(line.str());
+            }
+
+            void failed(const Job& job, Stage stage)
+            {
+                std::ostringstream line;
+                line << "FAIL " << job.id << " " << stageName(stage) << "\n";
+                record(line.str());
+            }
+
+            void finished(const Job& job)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_live.erase(job.id);
+                }
+
+                std::ostringstream line;
+                line << "FINISH " << job.id << "\n";
+                record(line.str());
+            }
+
+            static const size_t COMPACT_THRESHOLD;
+            static const size_t COMPACT_RATIO;
+        };
+
+        const size_t Journal::COMPACT_THRESHOLD{ 1000 };
+        const size_t Journal::COMPACT_RATIO{ 4 };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+Journal::Journal(const std::string& file)
+    : m_impl(new priv::Journal(file))
+{
+}
+
+Journal::~Journal()
+{
+}
+
+bool Journal::load(std::vector<Job>& pending)
+{
+    return m_impl->load(pending);
+}
+
+void Journal::sync()
+{
+    return m_impl->sync();
+}
+
+void Journal::stop()
+{
+    return m_impl->stop();
+}
+
+void Journal::whenSynced(const std::function<void(bool)>& done)
+{
+    return m_impl->whenSynced(done);
+}
+
+void Journal::accept(Job& job)
+{
+    return m_impl->accept(job);
+}
+
+void Journal::accept(std::vector<Job>& jobs)
+{
+    std::vector<Job*> pointers;
+    for (auto& job : jobs)
+        pointers.push_back(&job);
+
+    return m_impl->accept(pointers);
+}
+
+void Journal::started(const Job& job, Stage stage)
+{
+    return m_impl->started(job, stage);
+}
+
+void Journal::failed(const Job& job, Stage stage)
+{
+    return m_impl->failed(job, stage);
+}
+
+void Journal::finished(const Job& job)
+{
+    return m_impl->finished(job);
+}
@@ -0,0 +1,197 @@
+#include <build-bot/macros.h>
+#include <build-bot/name.h>
+
+#include <algorithm>
+
+#include <boost/unordered_map.hpp>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class MacroTable : public dsn::log::Base<MacroTable> {
+        private:
+            std::vector<dsn::build_bot::MacroTable::Macro> m_macros;
+
+            /// Index into m_macros by name
+            boost::unordered_map<std::string, size_t, NameHash, NameEqual> m_index;
+
+        public:
+            bool load(const boost::property_tree::ptree& macros)
+            {
+                for (auto& kv : macros) {
+                    if (!kv.second.empty()) {
+                        BOOST_LOG_SEV(log, severity::warning) << "Ignoring section " << kv.first << " in macro configuration";
+                        continue;
+                    }
+
+                    m_index.emplace(kv.first, m_macros.size());
+                    m_macros.push_back(dsn::build_bot::MacroTable::Macro(kv.first, kv.second.data()));
+                }
+
+                BOOST_LOG_SEV(log, severity::debug) << "Loaded " << m_macros.size() << " macro(s)";
+                return true;
+            }
+
+            const std::string* find(boost::string_ref name) const
+            {
+                auto it = m_index.find(name, NameHash(), NameEqual());
+                return (it == m_index.end() ? nullptr : &m_macros[it->second].second);
+            }
+
+            const std::vector<dsn::build_bot::MacroTable::Macro>& macros() const
+            {
+                return m_macros;
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+MacroTable::MacroTable()
+    : m_impl(new priv::MacroTable())
+{
+}
+
+MacroTable::~MacroTable()
+{
+}
+
+bool MacroTable::load(const boost::property_tree::ptree& macros)
+{
+    return m_impl->load(macros);
+}
+
+const std::string* MacroTable::find(boost::string_ref name) const
+{
+    return m_impl->find(name);
+}
+
+const std::vector<MacroTable::Macro>& MacroTable::macros() const
+{
+    return m_impl->macros();
+}
+
+MacroScope::MacroScope(const std::shared_ptr<const MacroTable>& table)
+    : m_table(table)
+{
+}
+
+void MacroScope::set(const std::string& name, const std::string& value)
+{
+    for (auto& macro : m_own) {
+        if (macro.first == name) {
+            macro.second = value;
+            return;
+        }
+    }
+
+    m_own.push_back(MacroTable::Macro(name, value));
+}
+
+const std::string* MacroScope::own(boost::string_ref name) const
+{
+    for (auto& macro : m_own) {
+        if (name == macro.first)
+            return &macro.second;
+    }
+
+    return nullptr;
+}
+
+const std::string* MacroScope::find(boost::string_ref name) const
+{
+    const std::string* res = own(name);
+    return (res ? res : m_table->find(name));
+}
+
+MacroTemplate::MacroTemplate(const std::string& text)
+    : m_text(text)
+    , m_literalLength(0)
+    , m_macroCount(0)
+{
+    size_t literal{ 0 };
+    size_t pos{ 0 };
+    while ((pos = m_text.find('@', pos)) != std::string::npos) {
+        size_t end = pos + 1;
+        while (end < m_text.size() && isNameCharacter(m_text[end]))
+            ++end;
+
+        if (end == pos + 1 || end == m_text.size() || m_text[end] != '@') {
+            ++pos;
+            continue;
+        }
+
+        if (pos > literal) {
+            m_segments.push_back(Segment{ literal, pos - literal, false });
+            m_literalLength += pos - literal;
+        }
+
+        m_segments.push_back(Segment{ pos + 1, end - pos - 1, true });
+        ++m_macroCount;
+
+        literal = pos = end + 1;
+    }
+
+    if (literal < m_text.size()) {
+        m_segments.push_back(Segment{ literal, m_text.size() - literal, false });
+        m_literalLength += m_text.size() - literal;
+    }
+}
+
+bool MacroTemplate::isNameCharacter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.';
+}
+
+const std::string& MacroTemplate::text() const
+{
+    return m_text;
+}
+
+bool MacroTemplate::expand(const MacroScope& macros, std::string& res, std::vector<std::string>& undefined) const
+{
+    if (m_macroCount == 0) {
+        res = m_text;
+        return true;
+    }
+
+    // look up every reference once, so the size of the result is known up front
+    std::vector<const std::string*> values;
+    values.reserve(m_macroCount);
+
+    size_t length{ m_literalLength };
+    bool complete{ true };
+    for (auto& segment : m_segments) {
+        if (!segment.macro)
+            continue;
+
+        boost::string_ref name(m_text.data() + segment.offset, segment.length);
+        const std::string* value = macros.find(name);
+        if (!value) {
+            if (std::find(undefined.begin(), undefined.end(), name) == undefined.end())
+                undefined.push_back(name.to_string());
+            complete = false;
+            continue;
+        }
+
+        length += value->size();
+        values.push_back(value);
+    }
+
+    if (!complete)
+        return false;
+
+    res.clear();
+    res.reserve(length);
+    auto value = values.begin();
+    for (auto& segment : m_segments) {
+        if (segment.macro)
+            res.append(**value++);
+        else
+            res.append(m_text, segment.offset, segment.length);
+    }
+
+    return true;
+}
@@ -49,8 +49,10 @@ int main(int argc, char** argv)
         return EXIT_FAILURE;
     case dsn::build_bot::Bot::ExitCode::Restart:
         if (execv(argv[0], argv) == -1) {
+            // the pipeline is held and the journal stopped for the handover already; the
+            // next start replays the journal and recovers the process groups left behind
             BOOST_LOG_TRIVIAL(fatal) << "execv() failed: " << strerror(errno);
-            return EXIT_FAILURE;
+            _exit(EXIT_FAILURE);
         }
     }
 
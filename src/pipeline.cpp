@@ -0,0 +1,851 @@
+#include <build-bot/pipeline.h>
+#include <build-bot/cpuset.h>
+#include <build-bot/journal.h>
+#include <build-bot/scheduler.h>
+#include <build-bot/worker.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class PipelineStage : public dsn::log::Base<PipelineStage> {
+        public:
+            typedef std::function<bool(dsn::build_bot::Worker&)> Handler;
+            typedef std::function<void(const Job&, bool)> Continuation;
+
+        private:
+            typedef dsn::build_bot::Scheduler::Clock Clock;
+
+            struct Running {
+                Job job;
+
+                /// Lease on the job's CPUs, 0 if CPUs aren't partitioned. A job preempting
+                /// another one shares its lease, so the CPUs are only given back once both
+                /// have finished.
+                dsn::build_bot::CpuSetAllocator::Lease lease;
+
+                /// Set while the job is stopped to make room for a higher priority one
+                bool suspended;
+                Clock::time_point suspendedAt;
+
+                /// The job this one has suspended to get its slot
+                const dsn::build_bot::Worker* victim;
+
+                /// Set if the job finished this stage while the stage was held; it is handed
+                /// over to the stage it would have continued with
+                bool done;
+                bool success;
+            };
+
+            dsn::build_bot::Stage m_stage;
+            std::string m_name;
+            size_t m_slots;
+            size_t m_preemptSlots;
+            bool m_drain;
+
+            Handler m_handler;
+            Continuation m_next;
+            dsn::build_bot::Scheduler& m_scheduler;
+
+            dsn::build_bot::CpuSetAllocator* m_cpus;
+            dsn::build_bot::Journal* m_journal;
+
+            std::deque<Job> m_queue;
+            std::list<Running> m_running;
+            size_t m_suspended;
+            size_t m_preemptions;
+            double m_preemptedSeconds;
+
+            mutable std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::vector<std::thread> m_threads;
+            bool m_stopping;
+            bool m_frozen;
+            bool m_killed;
+            bool m_held;
+
+            /// Jobs which have left m_running but haven't been handed to m_next completely yet
+            size_t m_continuing;
+
+            /// Lowest priority job which isn't suspended yet and may be suspended for the given
+            /// one; of several candidates the one started last loses the least progress.
+            Running* preemptionVictim(const Job& job)
+            {
+                if (m_suspended >= m_preemptSlots)
+                    return nullptr;
+
+                Running* res{ nullptr };
+                for (auto& running : m_running) {
+                    if (running.suspended || running.job.priority >= job.priority)
+                        continue;
+
+                    if (!res || running.job.priority <= res->job.priority)
+                        res = &running;
+                }
+
+                return res;
+            }
+
+            /// Pins the job's worker right away and again whenever the CPUs are rebalanced
+            dsn::build_bot::CpuSetAllocator::Pin pin(const Job& job)
+            {
+                auto worker = job.worker;
+                std::string name = m_name + " stage of " + job.repository;
+                return [this, worker, name](const dsn::build_bot::CpuSetAllocator::CpuSet& cpus) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Pinning " << name << " to " << cpus.size() << " CPU(s)";
+                    worker->setCpuAffinity(cpus);
+                };
+            }
+
+            void resume(Running& running)
+            {
+                double lost = std::chrono::duration<double>(Clock::now() - running.suspendedAt).count();
+                running.job.worker->resume();
+                running.suspended = false;
+                m_suspended--;
+                m_preemptedSeconds += lost;
+
+                BOOST_LOG_SEV(log, severity::info) << "Resuming " << m_name << " stage of " << running.job.repository << " (" << running.job.profile
+                                                   << ") after " << lost << "s; " << m_preemptions << " preemption(s) have cost "
+                                                   << m_preemptedSeconds << "s so far";
+            }
+
+            void loop()
+            {
+                for (;;) {
+                    std::list<Running>::iterator self;
+                    {
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        for (;;) {
+                            // a frozen stage doesn't start anything anymore, not even to drain
+                            if (m_stopping && (m_queue.empty() || !m_drain || m_frozen))
+                                return;
+
+                            bool dispatched{ false };
+                            bool full = m_running.size() - m_suspended >= m_slots;
+                            for (auto idx : (m_frozen ? std::vector<size_t>() : m_scheduler.rank(m_queue, m_stage))) {
+                                auto it = m_queue.begin() + idx;
+
+                                // jobs are ranked by priority first, so if this one can't preempt
+                                // anything none of the following can either
+                                Running* victim{ nullptr };
+                                if (full && !(victim = preemptionVictim(*it)))
+                                    break;
+
+                                if (m_scheduler.reserve(*it, m_stage)) {
+                                    Running running;
+                                    running.job = *it;
+                                    running.lease = 0;
+                                    running.suspended = false;
+                                    running.victim = nullptr;
+                                    running.done = false;
+                                    running.success = false;
+                                    m_queue.erase(it);
+
+                                    if (victim) {
+                                        BOOST_LOG_SEV(log, severity::info) << "Suspending " << m_name << " stage of " << victim->job.repository << " ("
+                                                                           << victim->job.profile << ") for " << priorityName(running.job.priority)
+                                                                           << " priority job of " << running.job.repository;
+                                        victim->job.worker->suspend();
+                                        victim->suspended = true;
+                                        victim->suspendedAt = Clock::now();
+                                        m_suspended++;
+                                        m_preemptions++;
+
+                                        // the suspended job doesn't use its CPUs until it is resumed
+                                        if (victim->lease != 0)
+                                            running.lease = m_cpus->share(victim->lease, pin(running.job));
+                                        running.victim = victim->job.worker.get();
+                                    }
+
+                                    else if (m_cpus) {
+                                        running.lease = m_cpus->allocate(pin(running.job));
+                                    }
+
+                                    self = m_running.insert(m_running.end(), running);
+                                    dispatched = true;
+                                    break;
+                                }
+
+                                if (!m_scheduler.backfill(*it))
+                                    break;
+                            }
+
+                            if (dispatched)
+                                break;
+
+                            m_cond.wait(lock);
+                        }
+                    }
+
+                    Job job = self->job;
+
+                    auto start = Clock::now();
+                    m_scheduler.started(job, m_stage, start);
+                    if (m_journal)
+                        m_journal->started(job, m_stage);
+
+                    bool success{ false };
+                    try {
+                        success = m_handler(*job.worker);
+                    }
+
+                    catch (std::exception& ex) {
+                        BOOST_LOG_SEV(log, severity::error) << "Unhandled exception in " << m_name << " stage: " << ex.what();
+                    }
+
+                    {
+                        // nothing a held job does may reach the journal or the next stage,
+                        // the next process image continues it from the snapshot
+                        std::unique_lock<std::mutex> lock(m_mutex);
+                        if (m_held) {
+                            self->done = true;
+                            self->success = success;
+                            m_cond.notify_all();
+                            m_cond.wait(lock, [&]() { return !m_held; });
+                        }
+                    }
+
+                    m_scheduler.finished(job, m_stage, start, success);
+                    m_scheduler.release(job, m_stage);
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        // jobs killed at shutdown are run again on the next start
+                        if (!success && m_killed)
+                            job.aborted = true;
+
+                        if (m_cpus && self->lease != 0)
+                            m_cpus->release(self->lease);
+
+                        // a job may finish while suspended if it was stopped between two children
+                        if (self->suspended)
+                            resume(*self);
+
+                        if (self->victim) {
+                            for (auto& running : m_running) {
+                                if (running.job.worker.get() == self->victim && running.suspended)
+                                    resume(running);
+                            }
+                        }
+
+                        m_running.erase(self);
+                        m_continuing++;
+                    }
+
+                    if (m_journal && !success && !job.aborted)
+                        m_journal->failed(job, m_stage);
+
+                    // released resources may allow a delayed job to start
+                    m_cond.notify_all();
+                    m_next(job, success);
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_continuing--;
+                    }
+                    m_cond.notify_all();
+                }
+            }
+
+        public:
+            PipelineStage(dsn::build_bot::Stage stage, size_t slots, bool drain, dsn::build_bot::Scheduler& scheduler, Handler handler, Continuation next)
+                : m_stage(stage)
+                , m_name(stageName(stage))
+                , m_slots(slots)
+                , m_preemptSlots(0)
+                , m_drain(drain)
+                , m_handler(handler)
+                , m_next(next)
+                , m_scheduler(scheduler)
+                , m_cpus(nullptr)
+                , m_journal(nullptr)
+                , m_suspended(0)
+                , m_preemptions(0)
+                , m_preemptedSeconds(0.0)
+                , m_stopping(false)
+                , m_frozen(false)
+                , m_killed(false)
+                , m_held(false)
+                , m_continuing(0)
+            {
+            }
+
+            /// Records when jobs of this stage start and fail
+            void journal(dsn::build_bot::Journal* journal)
+            {
+                m_journal = journal;
+            }
+
+            /// Allows up to the given number of running jobs to be suspended for higher priority ones
+            void preempt(size_t slots)
+            {
+                m_preemptSlots = slots;
+            }
+
+            size_t preemptions() const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_preemptions;
+            }
+
+            /// Total time jobs of this stage spent suspended
+            double preemptedSeconds() const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_preemptedSeconds;
+            }
+
+            /// Runs every job of this stage on its own set of CPUs
+            void pin(dsn::build_bot::CpuSetAllocator* cpus)
+            {
+                m_cpus = cpus;
+            }
+
+            ~PipelineStage()
+            {
+                stop();
+            }
+
+            void start()
+            {
+                BOOST_LOG_SEV(log, severity::debug) << "Starting " << m_name << " stage with " << m_slots << " slot(s) and "
+                                                    << m_preemptSlots << " preemption slot(s)";
+                for (size_t i = 0; i < m_slots + m_preemptSlots; i++)
+                    m_threads.emplace_back(&PipelineStage::loop, this);
+            }
+
+            void push(Job job)
+            {
+                job.queued = std::chrono::steady_clock::now();
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_queue.push_back(job);
+                }
+                m_cond.notify_one();
+            }
+
+            /// Stops starting jobs and continues all suspended ones
+            void freeze()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_frozen = true;
+                for (auto& running : m_running) {
+                    if (running.suspended)
+                        resume(running);
+                }
+            }
+
+            /// Freezes the stage and keeps jobs which finish from then on from moving on. With
+            /// children set, exited children of running jobs aren't reaped either.
+            void hold(bool children)
+            {
+                freeze();
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_held = true;
+                if (children) {
+                    for (auto& running : m_running)
+                        running.job.worker->hold(true);
+                }
+            }
+
+            /// Waits until every running job has either finished while held or is waiting
+            /// for a child, so a snapshot taken afterwards doesn't change anymore
+            void waitHeld()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (m_continuing > 0 || !std::all_of(m_running.begin(), m_running.end(), [](const Running& running) {
+                    return running.done || running.job.worker->childGroup() > 0;
+                }))
+                    m_cond.wait_for(lock, HOLD_POLL_INTERVAL);
+            }
+
+            static const std::chrono::milliseconds HOLD_POLL_INTERVAL;
+
+            /// Waits until no job of this stage is running anymore
+            void waitIdle()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [&]() { return m_running.empty(); });
+            }
+
+            /// Waits until no job of this stage is running anymore or the deadline has passed
+            bool waitIdle(const Clock::time_point& deadline)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                return m_cond.wait_until(lock, deadline, [&]() { return m_running.empty(); });
+            }
+
+            /// Kills the process groups of all running jobs, which are then handed to the
+            /// continuation as aborted
+            size_t kill()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_killed = true;
+                for (auto& running : m_running) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Killing " << m_name << " stage of " << running.job.repository << " ("
+                                                          << running.job.profile << ")";
+                    running.job.worker->terminate();
+                }
+
+                return m_running.size();
+            }
+
+            /// Looks for a job of this stage; running is set if it has started already
+            bool find(uint64_t id, bool& running) const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& entry : m_running) {
+                    if (entry.job.id == id) {
+                        running = true;
+                        return true;
+                    }
+                }
+
+                for (auto& job : m_queue) {
+                    if (job.id == id) {
+                        running = false;
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            /// Hands a queued job to the continuation as failed or kills the process group of
+            /// a running one, which then fails on its own
+            bool cancel(uint64_t id)
+            {
+                Job job;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (auto& entry : m_running) {
+                        if (entry.job.id == id) {
+                            BOOST_LOG_SEV(log, severity::info) << "Cancelling running " << m_name << " stage of job " << id;
+                            entry.job.worker->terminate();
+                            return true;
+                        }
+                    }
+
+                    auto it = std::find_if(m_queue.begin(), m_queue.end(), [&](const Job& queued) { return queued.id == id; });
+                    if (it == m_queue.end())
+                        return false;
+
+                    job = *it;
+                    m_queue.erase(it);
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Cancelling job " << id << " queued for " << m_name << " stage";
+                m_next(job, false);
+                return true;
+            }
+
+            /// Appends all running and queued jobs of this stage
+            void snapshot(std::vector<dsn::build_bot::Pipeline::Handover>& jobs) const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& running : m_running) {
+                    if (!running.done)
+                        jobs.push_back({ running.job, m_stage, running.job.worker->childGroup() });
+                    else if (running.success && m_stage == dsn::build_bot::Stage::Configure)
+                        jobs.push_back({ running.job, dsn::build_bot::Stage::Build, 0 });
+                    else
+                        jobs.push_back({ running.job, dsn::build_bot::Stage::Cleanup, 0 });
+                }
+
+                for (auto& job : m_queue)
+                    jobs.push_back({ job, m_stage, 0 });
+            }
+
+            size_t queued() const
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_queue.size();
+            }
+
+            dsn::build_bot::Stage stage() const
+            {
+                return m_stage;
+            }
+
+            /// Waits for all running jobs of this stage and hands any jobs which are still
+            /// queued to the continuation as failed and aborted, so they still get cleaned
+            /// up but stay in the journal. Draining stages run their queue first unless they
+            /// have been frozen.
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_stopping)
+                        return;
+                    m_stopping = true;
+
+                    // the handover didn't happen after all, held jobs go on as usual
+                    m_held = false;
+                    for (auto& running : m_running)
+                        running.job.worker->hold(false);
+                }
+                m_cond.notify_all();
+
+                for (auto& thread : m_threads)
+                    thread.join();
+                m_threads.clear();
+
+                std::deque<Job> leftover;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    leftover.swap(m_queue);
+                }
+
+                if (leftover.size() > 0)
+                    BOOST_LOG_SEV(log, severity::warning) << "Dropping " << leftover.size() << " queued job(s) from " << m_name << " stage";
+
+                for (auto& job : leftover) {
+                    job.aborted = true;
+                    m_next(job, false);
+                }
+            }
+        };
+
+        class Pipeline : public dsn::log::Base<Pipeline> {
+        private:
+            std::shared_ptr<dsn::build_bot::Scheduler> m_scheduler;
+            std::shared_ptr<dsn::build_bot::CpuSetAllocator> m_cpus;
+            std::shared_ptr<dsn::build_bot::Journal> m_journal;
+
+            PipelineStage m_cleanup;
+            PipelineStage m_build;
+            PipelineStage m_configure;
+            PipelineStage m_acquire;
+
+            /// Continues a matrix build with one job per profile, all using the same checkout
+            void fanOut(const Job& job)
+            {
+                auto workers = job.worker->split();
+                if (workers.empty()) {
+                    BOOST_LOG_SEV(log, severity::error) << "Build configuration of " << job.repository << " doesn't define any profile!";
+                    m_cleanup.push(job);
+                    return;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Building " << workers.size() << " profile(s) of " << job.repository << " from one checkout";
+                // every profile is journaled as a build of its own before the matrix job is done
+                std::vector<Job> jobs;
+                for (auto& worker : workers) {
+                    Job profileJob = job;
+                    profileJob.worker = worker;
+                    profileJob.profile = worker->profile();
+                    if (m_journal)
+                        m_journal->accept(profileJob);
+                    jobs.push_back(profileJob);
+                }
+
+                if (m_journal)
+                    m_journal->finished(job);
+
+                for (auto& profileJob : jobs)
+                    m_configure.push(profileJob);
+            }
+
+        public:
+            Pipeline(const dsn::build_bot::Pipeline::Limits& limits, const std::shared_ptr<dsn::build_bot::Scheduler>& scheduler,
+                     const std::shared_ptr<dsn::build_bot::CpuSetAllocator>& cpus, const std::shared_ptr<dsn::build_bot::Journal>& journal)
+                : m_scheduler(scheduler)
+                , m_cpus(cpus)
+                , m_journal(journal)
+                , m_cleanup(dsn::build_bot::Stage::Cleanup, limits.cleanup, true, *m_scheduler,
+                      [](dsn::build_bot::Worker& worker) { worker.cleanup(); return true; },
+                      [this](const Job& job, bool) {
+                          if (m_journal && !job.aborted)
+                              m_journal->finished(job);
+                      })
+                , m_build(dsn::build_bot::Stage::Build, limits.build, false, *m_scheduler,
+                      [](dsn::build_bot::Worker& worker) { return worker.build(); },
+                      [this](const Job& job, bool) { m_cleanup.push(job); })
+                , m_configure(dsn::build_bot::Stage::Configure, limits.configure, false, *m_scheduler,
+                      [](dsn::build_bot::Worker& worker) { return worker.configure(); },
+                      [this](const Job& job, bool success) {
+                          if (success)
+                              m_build.push(job);
+                          else
+                              m_cleanup.push(job);
+                      })
+                , m_acquire(dsn::build_bot::Stage::Acquire, limits.acquire, false, *m_scheduler,
+                      [](dsn::build_bot::Worker& worker) { return worker.acquire(); },
+                      [this](const Job& job, bool success) {
+                          if (!success)
+                              m_cleanup.push(job);
+                          else if (job.profile == dsn::build_bot::Worker::ALL_PROFILES)
+                              fanOut(job);
+                          else
+                              m_configure.push(job);
+                      })
+            {
+                if (m_cpus) {
+                    m_configure.pin(m_cpus.get());
+                    m_build.pin(m_cpus.get());
+                }
+
+                // acquire and cleanup are mostly waiting for I/O and are better left alone
+                m_configure.preempt(limits.preempt);
+                m_build.preempt(limits.preempt);
+
+                if (m_journal) {
+                    m_acquire.journal(m_journal.get());
+                    m_configure.journal(m_journal.get());
+                    m_build.journal(m_journal.get());
+                }
+
+                m_cleanup.start();
+                m_build.start();
+                m_configure.start();
+                m_acquire.start();
+            }
+
+            ~Pipeline()
+            {
+                stop();
+            }
+
+            void enqueue(const Job& job)
+            {
+                m_acquire.push(job);
+            }
+
+            void enqueue(const Job& job, dsn::build_bot::Pipeline::Stage stage)
+            {
+                switch (stage) {
+                case dsn::build_bot::Pipeline::Stage::Acquire:
+                    return m_acquire.push(job);
+                case dsn::build_bot::Pipeline::Stage::Configure:
+                    return m_configure.push(job);
+                case dsn::build_bot::Pipeline::Stage::Build:
+                    return m_build.push(job);
+                case dsn::build_bot::Pipeline::Stage::Cleanup:
+                    return m_cleanup.push(job);
+                }
+            }
+
+            /// Jobs still in the acquire stage are left to the journal; running checkouts are
+            /// killed since they can't be resumed halfway. No job moves on or reaches the
+            /// journal after the snapshot: acquire, configure and build are held until the
+            /// process image is replaced, and cleanup finishes what it is running first.
+            std::vector<dsn::build_bot::Pipeline::Handover> handover()
+            {
+                m_acquire.hold(false);
+                m_configure.hold(true);
+                m_build.hold(true);
+
+                std::vector<dsn::build_bot::Pipeline::Handover> acquiring;
+                m_acquire.snapshot(acquiring);
+
+                std::set<uint64_t> excluded;
+                for (auto& entry : acquiring) {
+                    entry.job.worker->terminate();
+                    excluded.insert(entry.job.id);
+                }
+
+                for (auto stage : { &m_acquire, &m_configure, &m_build })
+                    stage->waitHeld();
+
+                m_cleanup.freeze();
+                m_cleanup.waitIdle();
+
+                std::vector<dsn::build_bot::Pipeline::Handover> jobs;
+                m_configure.snapshot(jobs);
+                m_build.snapshot(jobs);
+                m_cleanup.snapshot(jobs);
+
+                std::map<uint64_t, dsn::build_bot::Pipeline::Handover> latest;
+                for (auto& entry : jobs) {
+                    if (excluded.count(entry.job.id))
+                        continue;
+
+                    auto it = latest.find(entry.job.id);
+                    if (it == latest.end() || entry.stage > it->second.stage)
+                        latest[entry.job.id] = entry;
+                }
+
+                std::vector<dsn::build_bot::Pipeline::Handover> res;
+                for (auto& kv : latest)
+                    res.push_back(kv.second);
+
+                BOOST_LOG_SEV(log, severity::info) << "Handing over " << res.size() << " job(s); killed " << excluded.size() << " running checkout(s)";
+                return res;
+            }
+
+            /// Stages are visited front to back both while waiting and while killing, so a
+            /// job is never killed in one stage after the stage behind it has been emptied.
+            void drain(const std::chrono::seconds& deadline)
+            {
+                auto until = std::chrono::steady_clock::now() + deadline;
+
+                m_acquire.freeze();
+                m_configure.freeze();
+                m_build.freeze();
+
+                BOOST_LOG_SEV(log, severity::info) << "Waiting up to " << deadline.count() << "s for running jobs to finish";
+                bool idle{ true };
+                for (auto stage : { &m_acquire, &m_configure, &m_build })
+                    idle = stage->waitIdle(until) && idle;
+
+                if (!idle) {
+                    size_t killed{ 0 };
+                    for (auto stage : { &m_acquire, &m_configure, &m_build })
+                        killed += stage->kill();
+                    BOOST_LOG_SEV(log, severity::warning) << "Drain deadline passed; killed " << killed << " running job(s)";
+                }
+
+                stop();
+            }
+
+            /// Jobs waiting for acquire, configure or build
+            size_t queued() const
+            {
+                return m_acquire.queued() + m_configure.queued() + m_build.queued();
+            }
+
+            size_t queued(dsn::build_bot::Pipeline::Stage stage) const
+            {
+                switch (stage) {
+                case dsn::build_bot::Pipeline::Stage::Acquire:
+                    return m_acquire.queued();
+                case dsn::build_bot::Pipeline::Stage::Configure:
+                    return m_configure.queued();
+                case dsn::build_bot::Pipeline::Stage::Build:
+                    return m_build.queued();
+                case dsn::build_bot::Pipeline::Stage::Cleanup:
+                    return m_cleanup.queued();
+                }
+
+                return 0;
+            }
+
+            bool find(uint64_t id, dsn::build_bot::Pipeline::Stage& stage, bool& running) const
+            {
+                // back to front, so a job moving on while we look is found in its later stage
+                for (auto entry : { &m_cleanup, &m_build, &m_configure, &m_acquire }) {
+                    if (entry->find(id, running)) {
+                        stage = entry->stage();
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            /// Jobs which are being cleaned up already are left alone
+            bool cancel(uint64_t id)
+            {
+                for (auto entry : { &m_build, &m_configure, &m_acquire }) {
+                    if (entry->cancel(id))
+                        return true;
+                }
+
+                return false;
+            }
+
+            size_t preemptions() const
+            {
+                return m_configure.preemptions() + m_build.preemptions();
+            }
+
+            double preemptedSeconds() const
+            {
+                return m_configure.preemptedSeconds() + m_build.preemptedSeconds();
+            }
+
+            /// Stages are stopped front to back so that jobs finishing in one stage can
+            /// still be handed to the next one; cleanup is drained completely.
+            void stop()
+            {
+                m_acquire.stop();
+                m_configure.stop();
+                m_build.stop();
+                m_cleanup.stop();
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+const std::chrono::milliseconds priv::PipelineStage::HOLD_POLL_INTERVAL{ 10 };
+
+Pipeline::Pipeline(const Limits& limits, const std::shared_ptr<Scheduler>& scheduler, const std::shared_ptr<CpuSetAllocator>& cpus,
+                   const std::shared_ptr<Journal>& journal)
+    : m_impl(new priv::Pipeline(limits, scheduler, cpus, journal))
+{
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+void Pipeline::enqueue(const Job& job)
+{
+    return m_impl->enqueue(job);
+}
+
+void Pipeline::enqueue(const Job& job, Stage stage)
+{
+    return m_impl->enqueue(job, stage);
+}
+
+std::vector<Pipeline::Handover> Pipeline::handover()
+{
+    return m_impl->handover();
+}
+
+size_t Pipeline::queued() const
+{
+    return m_impl->queued();
+}
+
+size_t Pipeline::queued(Stage stage) const
+{
+    return m_impl->queued(stage);
+}
+
+bool Pipeline::find(uint64_t id, Stage& stage, bool& running) const
+{
+    return m_impl->find(id, stage, running);
+}
+
+bool Pipeline::cancel(uint64_t id)
+{
+    return m_impl->cancel(id);
+}
+
+size_t Pipeline::preemptions() const
+{
+    return m_impl->preemptions();
+}
+
+double Pipeline::preemptedSeconds() const
+{
+    return m_impl->preemptedSeconds();
+}
+
+void Pipeline::drain(const std::chrono::seconds& deadline)
+{
+    return m_impl->drain(deadline);
+}
+
+void Pipeline::stop()
+{
+    return m_impl->stop();
+}
@@ -0,0 +1,428 @@
+#include <build-bot/poller.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/process.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        /// Write end of the pipe git's output is bound to
+        struct PipeSink {
+            int fd;
+
+            int handle() const
+            {
+                return fd;
+            }
+        };
+
+        class Poller : public dsn::log::Base<Poller> {
+        private:
+            std::string m_file;
+            std::chrono::seconds m_interval;
+            std::chrono::milliseconds m_spacing;
+            dsn::build_bot::Poller::Callback m_moved;
+            std::string m_gitExecutable;
+
+            /// Last revision seen per repository and branch, and the part of it which has
+            /// been confirmed and goes to the state file
+            boost::property_tree::ptree m_seen;
+            boost::property_tree::ptree m_confirmed;
+            bool m_dirty;
+
+            std::map<std::string, dsn::build_bot::Poller::Target> m_targets;
+            std::map<std::string, std::chrono::steady_clock::time_point> m_polled;
+
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::thread m_thread;
+            pid_t m_child;
+            bool m_stopping;
+
+            /// Git doesn't allow colons in ref names
+            static boost::property_tree::ptree::path_type key(const std::string& repository, const std::string& branch)
+            {
+                return boost::property_tree::ptree::path_type(repository + ":" + branch, ':');
+            }
+
+            /// Same as History::save(): the state file is replaced as a whole
+            bool save(const boost::property_tree::ptree& state)
+            {
+                std::ostringstream contents;
+                try {
+                    boost::property_tree::write_ini(contents, state);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to serialize poller state: " << ex.what();
+                    return false;
+                }
+
+                std::string tempFile = m_file + ".tmp";
+                int fd = ::open(tempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to open " << tempFile << " for writing: " << strerror(errno);
+                    return false;
+                }
+
+                const std::string data = contents.str();
+                size_t written{ 0 };
+                while (written < data.size()) {
+                    ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+                    if (ret == -1 && errno == EINTR)
+                        continue;
+
+                    if (ret == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to write poller state to " << tempFile << ": " << strerror(errno);
+                        ::close(fd);
+                        return false;
+                    }
+
+                    written += ret;
+                }
+
+                if (::fsync(fd) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to sync poller state " << tempFile << ": " << strerror(errno);
+                    ::close(fd);
+                    return false;
+                }
+                ::close(fd);
+
+                try {
+                    fs::rename(tempFile, m_file);
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to replace poller state " << m_file << ": " << ex.what();
+                    return false;
+                }
+
+                return true;
+            }
+
+            /// Runs "git ls-remote" for all branches of the target and returns the heads it
+            /// reported; git runs without holding m_mutex, stop() kills it if it hangs.
+            bool listRemote(const dsn::build_bot::Poller::Target& target, std::map<std::string, std::string>& heads)
+            {
+                std::stringstream ssArgs;
+                ssArgs << m_gitExecutable << " ls-remote --heads " << target.url;
+                for (auto& branch : target.branches)
+                    ssArgs << " refs/heads/" << branch;
+                std::string args = ssArgs.str();
+                BOOST_LOG_SEV(log, severity::trace) << "Git command line is " << args;
+
+                int fds[2];
+                if (::pipe2(fds, O_CLOEXEC) == -1) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to create pipe for git ls-remote: " << strerror(errno);
+                    return false;
+                }
+
+                int exitCode{ -1 };
+                std::string output;
+                try {
+                    boost::process::child child = boost::process::execute(boost::process::initializers::run_exe(m_gitExecutable),
+                                                                          boost::process::initializers::set_cmd_line(args),
+                                                                          boost::process::initializers::bind_fd(STDOUT_FILENO, PipeSink{ fds[1] }),
+                                                                          boost::process::initializers::set_process_group());
+                    ::close(fds[1]);
+                    fds[1] = -1;
+
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_child = child.pid;
+                    }
+
+                    char buffer[4096];
+                    for (;;) {
+                        ssize_t ret = ::read(fds[0], buffer, sizeof(buffer));
+                        if (ret == -1 && errno == EINTR)
+                            continue;
+                        if (ret <= 0)
+                            break;
+                        output.append(buffer, ret);
+                    }
+
+                    // wait_for_exit() doesn't return for children killed by stop()
+                    int status{ 0 };
+                    pid_t ret;
+                    do {
+                        ret = ::waitpid(child.pid, &status, 0);
+                    } while (ret == -1 && errno == EINTR);
+                    if (ret == child.pid && WIFEXITED(status))
+                        exitCode = WEXITSTATUS(status);
+
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_child = -1;
+                    if (m_stopping)
+                        exitCode = -1;
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to run git ls-remote for " << target.repository << ": " << ex.what();
+                }
+
+                ::close(fds[0]);
+                if (fds[1] != -1)
+                    ::close(fds[1]);
+
+                // -1: git couldn't be run, was killed or we're stopping
+                if (exitCode == -1)
+                    return false;
+
+                if (exitCode != 0) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Got non-zero exit status from '" << args << "': " << exitCode;
+                    return false;
+                }
+
+                // lines are "<revision>\trefs/heads/<branch>"
+                static const std::string PREFIX{ "refs/heads/" };
+                std::istringstream lines(output);
+                std::string revision;
+                std::string ref;
+                while (lines >> revision >> ref) {
+                    if (ref.compare(0, PREFIX.size(), PREFIX) == 0)
+                        heads[ref.substr(PREFIX.size())] = revision;
+                }
+
+                return true;
+            }
+
+            void poll(const dsn::build_bot::Poller::Target& target)
+            {
+                std::map<std::string, std::string> heads;
+                if (!listRemote(target, heads))
+                    return;
+
+                std::vector<std::pair<std::string, std::string> > moved;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (auto& branch : target.branches) {
+                        auto head = heads.find(branch);
+                        if (head == heads.end())
+                            continue;
+
+                        std::string previous = m_seen.get<std::string>(key(target.repository, branch), "");
+                        if (previous == head->second)
+                            continue;
+
+                        m_seen.put(key(target.repository, branch), head->second);
+                        if (!previous.empty()) {
+                            moved.push_back(*head);
+                            continue;
+                        }
+
+                        BOOST_LOG_SEV(log, severity::info) << "Watching " << branch << " of " << target.repository << " at " << head->second;
+                        m_confirmed.put(key(target.repository, branch), head->second);
+                        m_dirty = true;
+                    }
+                }
+
+                for (auto& head : moved) {
+                    BOOST_LOG_SEV(log, severity::info) << "Branch " << head.first << " of " << target.repository << " moved to " << head.second;
+                    m_moved(target.repository, head.first, head.second);
+                }
+            }
+
+            /// Polls the repository which has waited longest once it is due, but never sooner
+            /// than m_spacing after the previous poll, so a long list of repositories doesn't
+            /// turn into a burst of requests. Saving the state in between doesn't reset that.
+            void poller()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                std::chrono::steady_clock::time_point spaced;
+                while (!m_stopping) {
+                    if (m_dirty) {
+                        boost::property_tree::ptree snapshot = m_confirmed;
+                        m_dirty = false;
+
+                        lock.unlock();
+                        save(snapshot);
+                        lock.lock();
+                        continue;
+                    }
+
+                    auto now = std::chrono::steady_clock::now();
+                    auto next = now + m_interval;
+                    const dsn::build_bot::Poller::Target* due{ nullptr };
+                    for (auto& kv : m_targets) {
+                        auto polled = m_polled.find(kv.first);
+                        // repositories which haven't been polled yet have waited longest
+                        auto at = (polled == m_polled.end() ? std::chrono::steady_clock::time_point() : polled->second + m_interval);
+                        if (at < next || !due) {
+                            next = at;
+                            due = &kv.second;
+                        }
+                    }
+
+                    if (next < spaced)
+                        next = spaced;
+
+                    if (!due || next > now) {
+                        m_cond.wait_until(lock, next);
+                        continue;
+                    }
+
+                    dsn::build_bot::Poller::Target target = *due;
+                    m_polled[target.repository] = now;
+
+                    lock.unlock();
+                    poll(target);
+                    lock.lock();
+
+                    spaced = std::chrono::steady_clock::now() + m_spacing;
+                }
+            }
+
+        public:
+            Poller(const std::string& file, std::chrono::seconds interval, size_t rate, const dsn::build_bot::Poller::Callback& moved)
+                : m_file(file)
+                , m_interval(interval)
+                , m_spacing(std::chrono::milliseconds(60000 / rate))
+                , m_moved(moved)
+                , m_dirty(false)
+                , m_child(-1)
+                , m_stopping(false)
+            {
+            }
+
+            ~Poller()
+            {
+                stop();
+            }
+
+            bool load()
+            {
+                if (!fs::exists(fs::path(m_file)))
+                    return true;
+
+                try {
+                    boost::property_tree::read_ini(m_file, m_confirmed);
+                }
+
+                catch (boost::property_tree::ini_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Discarding unreadable poller state " << m_file << ": " << ex.what();
+                    m_confirmed.clear();
+                }
+
+                m_seen = m_confirmed;
+                return true;
+            }
+
+            void configure(const std::vector<dsn::build_bot::Poller::Target>& targets)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_targets.clear();
+                    for (auto& target : targets)
+                        m_targets[target.repository] = target;
+                }
+                m_cond.notify_all();
+
+                BOOST_LOG_SEV(log, severity::debug) << "Polling " << targets.size() << " repositories";
+            }
+
+            bool start()
+            {
+                try {
+                    m_gitExecutable = boost::process::search_path("git");
+                }
+
+                catch (std::runtime_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to locate git executable in PATH: " << ex.what();
+                    return false;
+                }
+
+                if (m_gitExecutable.empty()) {
+                    BOOST_LOG_SEV(log, severity::error) << "No git executable found in PATH!";
+                    return false;
+                }
+
+                m_thread = std::thread(&Poller::poller, this);
+                return true;
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stopping = true;
+                    if (m_child > 0)
+                        ::kill(-m_child, SIGKILL);
+                }
+                m_cond.notify_all();
+
+                if (m_thread.joinable())
+                    m_thread.join();
+
+                // whatever was confirmed after the last save
+                if (m_dirty) {
+                    save(m_confirmed);
+                    m_dirty = false;
+                }
+            }
+
+            void confirm(const std::string& repository, const std::string& branch, const std::string& revision)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_confirmed.put(key(repository, branch), revision);
+                    m_dirty = true;
+                }
+                m_cond.notify_all();
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+Poller::Poller(const std::string& state_file, std::chrono::seconds interval, size_t rate, const Callback& moved)
+    : m_impl(new priv::Poller(state_file, interval, rate, moved))
+{
+}
+
+Poller::~Poller()
+{
+}
+
+bool Poller::load()
+{
+    return m_impl->load();
+}
+
+void Poller::configure(const std::vector<Target>& targets)
+{
+    return m_impl->configure(targets);
+}
+
+bool Poller::start()
+{
+    return m_impl->start();
+}
+
+void Poller::stop()
+{
+    return m_impl->stop();
+}
+
+void Poller::confirm(const std::string& repository, const std::string& branch, const std::string& revision)
+{
+    return m_impl->confirm(repository, branch, revision);
+}
@@ -0,0 +1,282 @@
+#include <build-bot/recovery.h>
+
+#include <signal.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Recovery : public dsn::log::Base<Recovery> {
+        private:
+            std::string m_buildDir;
+            size_t m_threads;
+
+            struct Child {
+                pid_t group;
+                unsigned long long startTime;
+                std::string workspace;
+            };
+
+            /// What scan() found: workspaces by path (with the process groups running in
+            /// them) and registered groups whose workspace is gone already
+            std::map<std::string, std::vector<Child> > m_workspaces;
+            std::vector<Child> m_children;
+
+            std::deque<std::pair<std::string, std::vector<Child> > > m_orphans;
+            std::mutex m_mutex;
+            std::vector<std::thread> m_workers;
+            bool m_stopping;
+
+            /// Start time of a process in clock ticks after boot, which tells a registered
+            /// process apart from a later one with the same PID
+            static bool startTime(pid_t pid, unsigned long long& res)
+            {
+                std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+                std::string line;
+                if (!std::getline(stat, line))
+                    return false;
+
+                // the command name may contain spaces, so fields are counted after its closing paren
+                size_t pos = line.rfind(')');
+                if (pos == std::string::npos)
+                    return false;
+
+                std::istringstream fields(line.substr(pos + 1));
+                std::string field;
+                for (int i = 3; i <= 22 && (fields >> field); i++) {
+                    if (i == 22) {
+                        res = std::stoull(field);
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            /// A process group ID can't be reused while any member of the group is alive,
+            /// so only a leader which is still around has to be checked.
+            void kill(const Child& child)
+            {
+                unsigned long long started{ 0 };
+                if (startTime(child.group, started) && started != child.startTime) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Process " << child.group << " isn't the registered child anymore";
+                }
+
+                else if (::kill(-child.group, SIGKILL) == 0) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Killed orphaned process group " << child.group << " in " << child.workspace;
+                }
+
+                boost::system::error_code error;
+                fs::remove(fs::path(m_buildDir + "/" + REGISTRY_DIRECTORY + "/" + std::to_string(child.group)), error);
+            }
+
+            void worker()
+            {
+                for (;;) {
+                    std::pair<std::string, std::vector<Child> > orphan;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        if (m_stopping || m_orphans.empty())
+                            return;
+
+                        orphan = m_orphans.front();
+                        m_orphans.pop_front();
+                    }
+
+                    for (auto& child : orphan.second)
+                        kill(child);
+
+                    if (orphan.first.empty())
+                        continue;
+
+                    BOOST_LOG_SEV(log, severity::info) << "Removing orphaned workspace " << orphan.first;
+                    boost::system::error_code error;
+                    fs::remove_all(fs::path(orphan.first), error);
+                    if (error)
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to remove orphaned workspace " << orphan.first << ": " << error.message();
+                }
+            }
+
+            /// Lists the subdirectories of the given directory, ignoring hidden ones
+            static std::vector<std::string> directories(const std::string& path)
+            {
+                std::vector<std::string> res;
+                boost::system::error_code error;
+                for (fs::directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+                    std::string name = it->path().filename().string();
+                    if (!name.empty() && name[0] != '.' && fs::is_directory(it->status()))
+                        res.push_back(name);
+                }
+
+                return res;
+            }
+
+        public:
+            Recovery(const std::string& build_dir, size_t threads)
+                : m_buildDir(build_dir)
+                , m_threads(threads)
+                , m_stopping(false)
+            {
+            }
+
+            ~Recovery()
+            {
+                stop();
+            }
+
+            bool scan()
+            {
+                // paths are built the same way Worker builds them, so they can be compared as strings
+                for (auto& profile : directories(m_buildDir)) {
+                    for (auto& repository : directories(m_buildDir + "/" + profile)) {
+                        std::string parent = m_buildDir + "/" + profile + "/" + repository;
+                        for (auto& id : directories(parent))
+                            m_workspaces[parent + "/" + id];
+                    }
+                }
+
+                std::string registry = m_buildDir + "/" + REGISTRY_DIRECTORY;
+                try {
+                    fs::create_directories(fs::path(registry));
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to create process registry " << registry << ": " << ex.what();
+                    return false;
+                }
+
+                size_t children{ 0 };
+                boost::system::error_code error;
+                for (fs::directory_iterator it(registry, error), end; !error && it != end; it.increment(error)) {
+                    Child child;
+                    child.group = std::atoi(it->path().filename().string().c_str());
+
+                    std::ifstream entry(it->path().string());
+                    if (child.group <= 0 || !(entry >> child.startTime) || !std::getline(entry >> std::ws, child.workspace)) {
+                        BOOST_LOG_SEV(log, severity::warning) << "Ignoring malformed process registry entry " << it->path().string();
+                        continue;
+                    }
+
+                    auto workspace = m_workspaces.find(child.workspace);
+                    if (workspace != m_workspaces.end())
+                        workspace->second.push_back(child);
+                    else
+                        m_children.push_back(child);
+                    children++;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Found " << m_workspaces.size() << " workspace(s) and " << children
+                                                   << " registered process group(s) in " << m_buildDir;
+                return true;
+            }
+
+            void start(const std::set<std::string>& adopted)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (auto& child : m_children)
+                        m_orphans.push_back(std::make_pair(std::string(), std::vector<Child>{ child }));
+
+                    for (auto& kv : m_workspaces) {
+                        if (!adopted.count(kv.first))
+                            m_orphans.push_back(kv);
+                    }
+                }
+
+                m_workspaces.clear();
+                m_children.clear();
+
+                if (m_orphans.empty())
+                    return;
+
+                BOOST_LOG_SEV(log, severity::info) << "Cleaning up " << m_orphans.size() << " orphan(s) in the background";
+                for (size_t i = 0; i < std::min(m_threads, m_orphans.size()); i++)
+                    m_workers.emplace_back(&Recovery::worker, this);
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stopping = true;
+                }
+
+                for (auto& worker : m_workers)
+                    worker.join();
+                m_workers.clear();
+            }
+
+            static bool registerChild(const std::string& build_dir, pid_t group, const std::string& workspace)
+            {
+                unsigned long long started{ 0 };
+                if (!startTime(group, started))
+                    return false;
+
+                std::ofstream entry(build_dir + "/" + REGISTRY_DIRECTORY + "/" + std::to_string(group), std::ios::trunc);
+                entry << started << " " << workspace << "\n";
+                return static_cast<bool>(entry.flush());
+            }
+
+            static void unregisterChild(const std::string& build_dir, pid_t group)
+            {
+                boost::system::error_code error;
+                fs::remove(fs::path(build_dir + "/" + REGISTRY_DIRECTORY + "/" + std::to_string(group)), error);
+            }
+
+            static const std::string REGISTRY_DIRECTORY;
+        };
+
+        const std::string Recovery::REGISTRY_DIRECTORY{ ".children" };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+Recovery::Recovery(const std::string& build_dir, size_t threads)
+    : m_impl(new priv::Recovery(build_dir, threads))
+{
+}
+
+Recovery::~Recovery()
+{
+}
+
+bool Recovery::scan()
+{
+    return m_impl->scan();
+}
+
+void Recovery::start(const std::set<std::string>& adopted)
+{
+    return m_impl->start(adopted);
+}
+
+void Recovery::stop()
+{
+    return m_impl->stop();
+}
+
+bool Recovery::registerChild(const std::string& build_dir, pid_t group, const std::string& workspace)
+{
+    return priv::Recovery::registerChild(build_dir, group, workspace);
+}
+
+void Recovery::unregisterChild(const std::string& build_dir, pid_t group)
+{
+    return priv::Recovery::unregisterChild(build_dir, group);
+}
@@ -0,0 +1,100 @@
+#include <build-bot/registry.h>
+#include <build-bot/name.h>
+
+#include <sstream>
+
+#include <boost/unordered_map.hpp>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Registry : public dsn::log::Base<Registry> {
+        private:
+            std::vector<dsn::build_bot::Repository> m_repositories;
+
+            /// Index into m_repositories by name
+            boost::unordered_map<std::string, size_t, NameHash, NameEqual> m_index;
+
+        public:
+            bool load(const boost::property_tree::ptree& repositories)
+            {
+                for (auto& section : repositories) {
+                    dsn::build_bot::Repository repository;
+                    repository.name = section.first;
+                    repository.url = section.second.get<std::string>("url", "");
+                    repository.config = section.second.get<std::string>("config", "");
+                    if (repository.url.empty() || repository.config.empty()) {
+                        BOOST_LOG_SEV(log, severity::error) << "Ignoring repository " << repository.name << " without url or config";
+                        continue;
+                    }
+
+                    repository.weight = dsn::build_bot::Registry::DEFAULT_WEIGHT;
+                    if (section.second.get_optional<std::string>("weight")) {
+                        auto weight = section.second.get_optional<double>("weight");
+                        repository.weight = (weight ? *weight : 0.0);
+                    }
+
+                    if (repository.weight <= 0.0) {
+                        BOOST_LOG_SEV(log, severity::error) << "Ignoring repository " << repository.name << " with invalid weight "
+                                                            << section.second.get<std::string>("weight");
+                        continue;
+                    }
+
+                    std::istringstream branches(section.second.get<std::string>("poll", ""));
+                    for (std::string branch; branches >> branch;)
+                        repository.poll.push_back(branch);
+
+                    if (m_index.count(repository.name)) {
+                        BOOST_LOG_SEV(log, severity::error) << "Repository " << repository.name << " is configured twice";
+                        return false;
+                    }
+
+                    m_index.emplace(repository.name, m_repositories.size());
+                    m_repositories.push_back(repository);
+                }
+
+                return true;
+            }
+
+            const dsn::build_bot::Repository* find(boost::string_ref name) const
+            {
+                auto it = m_index.find(name, NameHash(), NameEqual());
+                return (it == m_index.end() ? nullptr : &m_repositories[it->second]);
+            }
+
+            const std::vector<dsn::build_bot::Repository>& repositories() const
+            {
+                return m_repositories;
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+const double Registry::DEFAULT_WEIGHT{ 1.0 };
+
+Registry::Registry()
+    : m_impl(new priv::Registry())
+{
+}
+
+Registry::~Registry()
+{
+}
+
+bool Registry::load(const boost::property_tree::ptree& repositories)
+{
+    return m_impl->load(repositories);
+}
+
+const Repository* Registry::find(boost::string_ref name) const
+{
+    return m_impl->find(name);
+}
+
+const std::vector<Repository>& Registry::repositories() const
+{
+    return m_impl->repositories();
+}
@@ -0,0 +1,320 @@
+#include <build-bot/scheduler.h>
+#include <build-bot/history.h>
+#include <build-bot/worker.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class Scheduler : public dsn::log::Base<Scheduler> {
+        private:
+            typedef dsn::build_bot::Scheduler::Clock Clock;
+
+            struct Usage {
+                Usage()
+                    : slotSeconds(0.0)
+                    , updated(Clock::now())
+                    , running(0)
+                    , runningSince(0.0)
+                {
+                }
+
+                /// Decayed slot-seconds of finished stage runs
+                double slotSeconds;
+                Clock::time_point updated;
+
+                /// Number of running jobs and the sum of their start times (in seconds)
+                size_t running;
+                double runningSince;
+            };
+
+            dsn::build_bot::Scheduler::Policy m_policy;
+            double m_halfLife;
+
+            std::shared_ptr<dsn::build_bot::History> m_history;
+            double m_aging;
+
+            /// Memory budget for the build stage and current reservations (in KiB)
+            double m_memoryBudget;
+            double m_memoryReserved;
+            double m_backfillLimit;
+            std::map<const dsn::build_bot::Worker*, double> m_reservations;
+
+            std::map<std::string, Usage> m_usage;
+            std::mutex m_mutex;
+
+            static double seconds(const Clock::time_point& time)
+            {
+                return std::chrono::duration<double>(time.time_since_epoch()).count();
+            }
+
+            void decay(Usage& usage, const Clock::time_point& now)
+            {
+                double age = std::chrono::duration<double>(now - usage.updated).count();
+                if (m_halfLife > 0.0 && age > 0.0)
+                    usage.slotSeconds *= std::exp2(-age / m_halfLife);
+                usage.updated = now;
+            }
+
+            /// Slot-seconds of a repository (including running jobs) divided by its weight
+            double share(const Job& job, const Clock::time_point& now)
+            {
+                auto it = m_usage.find(job.repository);
+                if (it == m_usage.end())
+                    return 0.0;
+
+                Usage& usage = it->second;
+                decay(usage, now);
+
+                double used = usage.slotSeconds + usage.running * seconds(now) - usage.runningSince;
+                return used / job.weight;
+            }
+
+            /// Expected run time of the given stage and all stages after it; stages
+            /// without history count as zero so that new profiles get measured quickly.
+            double remaining(const Job& job, Stage stage)
+            {
+                double res{ 0.0 };
+                for (int i = static_cast<int>(stage); i <= static_cast<int>(Stage::Cleanup); i++) {
+                    double estimate{ 0.0 };
+                    if (m_history->estimate(job.repository, job.profile, stageName(static_cast<Stage>(i)), estimate))
+                        res += estimate;
+                }
+
+                return res;
+            }
+
+            std::vector<size_t> rankShortest(const std::deque<Job>& queue, Stage stage)
+            {
+                Clock::time_point now = Clock::now();
+
+                std::vector<double> scores(queue.size());
+                for (size_t i = 0; i < queue.size(); i++) {
+                    double waited = std::chrono::duration<double>(now - queue[i].queued).count();
+                    scores[i] = remaining(queue[i], stage) - m_aging * waited;
+                }
+
+                std::vector<size_t> order(queue.size());
+                for (size_t i = 0; i < order.size(); i++)
+                    order[i] = i;
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] < scores[b]; });
+
+                return order;
+            }
+
+            std::vector<size_t> rankFairShare(const std::deque<Job>& queue)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Clock::time_point now = Clock::now();
+
+                std::vector<std::pair<double, double> > keys(queue.size());
+                for (size_t i = 0; i < queue.size(); i++) {
+                    const Job& job = queue[i];
+                    auto it = m_usage.find(job.repository);
+                    double running = (it != m_usage.end() ? it->second.running : 0) / job.weight;
+                    keys[i] = std::make_pair(share(job, now), running);
+                }
+
+                std::vector<size_t> order(queue.size());
+                for (size_t i = 0; i < order.size(); i++)
+                    order[i] = i;
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+                return order;
+            }
+
+        public:
+            Scheduler(dsn::build_bot::Scheduler::Policy policy, const std::chrono::seconds& half_life,
+                      const std::shared_ptr<dsn::build_bot::History>& history, double aging, size_t memory_budget,
+                      const std::chrono::seconds& backfill_limit)
+                : m_policy(policy)
+                , m_halfLife(std::chrono::duration<double>(half_life).count())
+                , m_history(history)
+                , m_aging(aging)
+                , m_memoryBudget(memory_budget * 1024.0)
+                , m_memoryReserved(0.0)
+                , m_backfillLimit(std::chrono::duration<double>(backfill_limit).count())
+            {
+            }
+
+            /// A build always fits if nothing else is running, so oversized jobs can't block the
+            /// stage forever. Profiles without a recorded peak are assumed to need the whole budget.
+            bool reserve(const Job& job, Stage stage)
+            {
+                if (stage != Stage::Build || m_memoryBudget <= 0.0)
+                    return true;
+
+                double predicted{ m_memoryBudget };
+                if (m_history)
+                    m_history->estimate(job.repository, job.profile, PEAK_MEMORY_METRIC, predicted);
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_reservations.empty() && m_memoryReserved + predicted > m_memoryBudget) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Delaying build of " << job.repository << " (" << job.profile << "): predicted peak of "
+                                                        << predicted << " KiB doesn't fit into remaining budget of " << (m_memoryBudget - m_memoryReserved) << " KiB";
+                    return false;
+                }
+
+                m_memoryReserved += predicted;
+                m_reservations[job.worker.get()] = predicted;
+                return true;
+            }
+
+            void release(const Job& job, Stage stage)
+            {
+                if (stage != Stage::Build || m_memoryBudget <= 0.0)
+                    return;
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_reservations.find(job.worker.get());
+                if (it == m_reservations.end())
+                    return;
+
+                m_memoryReserved -= it->second;
+                m_reservations.erase(it);
+                if (m_reservations.empty())
+                    m_memoryReserved = 0.0;
+            }
+
+            /// Higher priorities always come first; the policy orders jobs of equal priority
+            std::vector<size_t> rank(const std::deque<Job>& queue, Stage stage)
+            {
+                std::vector<size_t> order;
+                if (m_policy == dsn::build_bot::Scheduler::Policy::ShortestJobFirst && m_history) {
+                    order = rankShortest(queue, stage);
+                }
+
+                else if (m_policy == dsn::build_bot::Scheduler::Policy::FairShare) {
+                    order = rankFairShare(queue);
+                }
+
+                else {
+                    order.resize(queue.size());
+                    for (size_t i = 0; i < order.size(); i++)
+                        order[i] = i;
+                }
+
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return queue[a].priority > queue[b].priority; });
+                return order;
+            }
+
+            bool backfill(const Job& blocked)
+            {
+                return std::chrono::duration<double>(Clock::now() - blocked.queued).count() < m_backfillLimit;
+            }
+
+            void started(const Job& job, Stage, const Clock::time_point& start)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Usage& usage = m_usage[job.repository];
+                usage.running++;
+                usage.runningSince += seconds(start);
+            }
+
+            void finished(const Job& job, Stage stage, const Clock::time_point& start, bool success)
+            {
+                Clock::time_point now = Clock::now();
+                double elapsed = std::chrono::duration<double>(now - start).count();
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+
+                    Usage& usage = m_usage[job.repository];
+                    decay(usage, now);
+                    usage.running--;
+                    usage.runningSince -= seconds(start);
+                    usage.slotSeconds += elapsed;
+
+                    BOOST_LOG_SEV(log, severity::trace) << "Repository " << job.repository << " has used " << usage.slotSeconds
+                                                        << " decayed slot-seconds (weight: " << job.weight << ")";
+                }
+
+                if (!m_history)
+                    return;
+
+                if (success)
+                    m_history->record(job.repository, job.profile, stageName(stage), elapsed);
+
+                if (stage != Stage::Build)
+                    return;
+
+                // failed builds still count here, they may well have been killed for using too much
+                // memory; builds which failed before their command ran have nothing to report
+                long peak = job.worker->peakMemory();
+                if (peak > 0)
+                    m_history->recordPeak(job.repository, job.profile, PEAK_MEMORY_METRIC, peak);
+            }
+
+            static const std::string PEAK_MEMORY_METRIC;
+        };
+
+        const std::string Scheduler::PEAK_MEMORY_METRIC{ "peak_rss" };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+Scheduler::Scheduler(Policy policy, const std::chrono::seconds& half_life, const std::shared_ptr<History>& history, double aging,
+                     size_t memory_budget, const std::chrono::seconds& backfill_limit)
+    : m_impl(new priv::Scheduler(policy, half_life, history, aging, memory_budget, backfill_limit))
+{
+}
+
+Scheduler::~Scheduler()
+{
+}
+
+std::vector<size_t> Scheduler::rank(const std::deque<Job>& queue, Stage stage)
+{
+    return m_impl->rank(queue, stage);
+}
+
+bool Scheduler::backfill(const Job& blocked)
+{
+    return m_impl->backfill(blocked);
+}
+
+bool Scheduler::reserve(const Job& job, Stage stage)
+{
+    return m_impl->reserve(job, stage);
+}
+
+void Scheduler::release(const Job& job, Stage stage)
+{
+    return m_impl->release(job, stage);
+}
+
+void Scheduler::started(const Job& job, Stage stage, const Clock::time_point& start)
+{
+    return m_impl->started(job, stage, start);
+}
+
+void Scheduler::finished(const Job& job, Stage stage, const Clock::time_point& start, bool success)
+{
+    return m_impl->finished(job, stage, start, success);
+}
+
+bool Scheduler::policyFromString(const std::string& name, Policy& policy)
+{
+    if (name == "fifo") {
+        policy = Policy::Fifo;
+        return true;
+    }
+
+    if (name == "fair") {
+        policy = Policy::FairShare;
+        return true;
+    }
+
+    if (name == "sjf") {
+        policy = Policy::ShortestJobFirst;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,150 @@
+#include <build-bot/watcher.h>
+
+#include <sys/inotify.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <array>
+#include <map>
+#include <set>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class FileWatcher : public dsn::log::Base<FileWatcher> {
+        private:
+            boost::asio::posix::stream_descriptor m_stream;
+            boost::asio::io_service::strand& m_strand;
+            dsn::build_bot::FileWatcher::Callback m_changed;
+
+            /// Watched directories by watch descriptor and the absolute paths of the watched files
+            std::map<int, std::string> m_directories;
+            std::set<std::string> m_files;
+
+            std::array<char, 4096> m_buffer;
+            bool m_reading;
+
+            void read(const boost::system::error_code& error, size_t bytes)
+            {
+                if (error) {
+                    if (error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to read inotify events: " << boost::system::system_error(error).what();
+                    m_reading = false;
+                    return;
+                }
+
+                // a single callback for everything reported at once, editors tend to cause several events
+                bool changed{ false };
+                for (size_t pos = 0; pos + sizeof(struct inotify_event) <= bytes;) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(m_buffer.data() + pos);
+                    pos += sizeof(struct inotify_event) + event->len;
+
+                    auto it = m_directories.find(event->wd);
+                    if (event->len == 0 || it == m_directories.end())
+                        continue;
+
+                    std::string path = it->second + "/" + event->name;
+                    if (m_files.count(path)) {
+                        BOOST_LOG_SEV(log, severity::debug) << "Watched file " << path << " changed";
+                        changed = true;
+                    }
+                }
+
+                arm();
+
+                if (changed)
+                    m_changed();
+            }
+
+            void arm()
+            {
+                m_reading = true;
+                m_stream.async_read_some(boost::asio::buffer(m_buffer),
+                    m_strand.wrap(boost::bind(&FileWatcher::read, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+            }
+
+        public:
+            FileWatcher(boost::asio::io_service& io, boost::asio::io_service::strand& strand, const dsn::build_bot::FileWatcher::Callback& changed)
+                : m_stream(io)
+                , m_strand(strand)
+                , m_changed(changed)
+                , m_reading(false)
+            {
+            }
+
+            ~FileWatcher()
+            {
+                if (m_stream.is_open())
+                    m_stream.close();
+            }
+
+            bool watch(const std::vector<std::string>& files)
+            {
+                if (!m_stream.is_open()) {
+                    int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                    if (fd == -1) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to initialize inotify: " << strerror(errno);
+                        return false;
+                    }
+
+                    boost::system::error_code error;
+                    m_stream.assign(fd, error);
+                    if (error) {
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to assign inotify fd to stream_descriptor: " << boost::system::system_error(error).what();
+                        ::close(fd);
+                        return false;
+                    }
+                }
+
+                for (auto& kv : m_directories)
+                    ::inotify_rm_watch(m_stream.native_handle(), kv.first);
+                m_directories.clear();
+                m_files.clear();
+
+                for (auto& file : files) {
+                    fs::path path = fs::absolute(fs::path(file));
+                    std::string directory = path.parent_path().string();
+
+                    int wd = ::inotify_add_watch(m_stream.native_handle(), directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+                    if (wd == -1) {
+                        BOOST_LOG_SEV(log, severity::warning) << "Failed to watch " << directory << " for changes: " << strerror(errno);
+                        continue;
+                    }
+
+                    // watching the same directory twice returns the same descriptor
+                    m_directories[wd] = directory;
+                    m_files.insert(path.string());
+                    BOOST_LOG_SEV(log, severity::trace) << "Watching " << path.string() << " for changes";
+                }
+
+                if (!m_reading)
+                    arm();
+
+                return true;
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+FileWatcher::FileWatcher(boost::asio::io_service& io, boost::asio::io_service::strand& strand, const Callback& changed)
+    : m_impl(new priv::FileWatcher(io, strand, changed))
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+bool FileWatcher::watch(const std::vector<std::string>& files)
+{
+    return m_impl->watch(files);
+}
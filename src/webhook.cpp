@@ -0,0 +1,370 @@
+#include <build-bot/webhook.h>
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace dsn {
+namespace build_bot {
+    namespace priv {
+        class WebhookSession : public std::enable_shared_from_this<WebhookSession>, public dsn::log::Base<WebhookSession> {
+        private:
+            boost::asio::ip::tcp::socket m_socket;
+            boost::asio::streambuf m_buffer;
+            dsn::build_bot::Webhook::Handler m_handler;
+            dsn::build_bot::ControlSocket::Gate m_gate;
+            size_t m_maxBody;
+
+            /// State of the request being handled
+            size_t m_contentLength;
+            bool m_keepAlive;
+            std::string m_response;
+
+            void readRequest()
+            {
+                auto self = shared_from_this();
+                m_gate([self]() {
+                    boost::asio::async_read_until(self->m_socket, self->m_buffer, "\r\n\r\n",
+                        boost::bind(&WebhookSession::headerRead, self, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+                });
+            }
+
+            void headerRead(const boost::system::error_code& error, size_t bytes)
+            {
+                if (error == boost::asio::error::not_found)
+                    return respond(431, "request header too large", false);
+
+                if (error) {
+                    if (error != boost::asio::error::eof && error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::warning) << "Closing webhook connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                std::string header(boost::asio::buffer_cast<const char*>(m_buffer.data()), bytes - 4);
+                m_buffer.consume(bytes);
+
+                std::vector<std::string> lines;
+                boost::algorithm::split(lines, header, boost::algorithm::is_any_of("\n"));
+
+                std::vector<std::string> request;
+                boost::algorithm::split(request, boost::algorithm::trim_copy(lines[0]), boost::algorithm::is_any_of(" "));
+                if (request.size() != 3 || !boost::algorithm::starts_with(request[2], "HTTP/1."))
+                    return respond(400, "malformed request line", false);
+
+                bool hasLength{ false };
+                bool chunked{ false };
+                bool expectContinue{ false };
+                std::string connection;
+                for (size_t i = 1; i < lines.size(); i++) {
+                    size_t colon = lines[i].find(':');
+                    if (colon == std::string::npos)
+                        return respond(400, "malformed header line", false);
+
+                    std::string name = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(lines[i].substr(0, colon)));
+                    std::string value = boost::algorithm::trim_copy(lines[i].substr(colon + 1));
+                    if (name == "content-length") {
+                        if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string::npos)
+                            return respond(400, "invalid Content-Length", false);
+                        m_contentLength = std::stoull(value);
+                        hasLength = true;
+                    }
+
+                    else if (name == "transfer-encoding") {
+                        chunked = true;
+                    }
+
+                    else if (name == "expect") {
+                        expectContinue = boost::algorithm::iequals(value, "100-continue");
+                    }
+
+                    else if (name == "connection") {
+                        connection = value;
+                    }
+                }
+
+                // HTTP/1.0 clients have to ask for persistent connections
+                if (request[2] == "HTTP/1.0")
+                    m_keepAlive = boost::algorithm::iequals(connection, "keep-alive");
+                else
+                    m_keepAlive = !boost::algorithm::iequals(connection, "close");
+
+                // without reading the body there's no telling where the next request starts
+                if (request[0] != "POST")
+                    return respond(405, "only POST is supported", false);
+
+                if (chunked || !hasLength)
+                    return respond(411, "a Content-Length is required", false);
+
+                if (m_contentLength > m_maxBody)
+                    return respond(413, "body exceeds " + std::to_string(m_maxBody) + " bytes", false);
+
+                if (!expectContinue)
+                    return readBody();
+
+                m_response = "HTTP/1.1 100 Continue\r\n\r\n";
+                boost::asio::async_write(m_socket, boost::asio::buffer(m_response),
+                    boost::bind(&WebhookSession::bodyRead, shared_from_this(), boost::asio::placeholders::error));
+            }
+
+            void readBody()
+            {
+                if (m_buffer.size() < m_contentLength) {
+                    boost::asio::async_read(m_socket, m_buffer, boost::asio::transfer_exactly(m_contentLength - m_buffer.size()),
+                        boost::bind(&WebhookSession::bodyRead, shared_from_this(), boost::asio::placeholders::error));
+                    return;
+                }
+
+                std::istringstream body(std::string(boost::asio::buffer_cast<const char*>(m_buffer.data()), m_contentLength));
+                m_buffer.consume(m_contentLength);
+
+                boost::property_tree::ptree event;
+                try {
+                    boost::property_tree::read_json(body, event);
+                }
+
+                catch (boost::property_tree::json_parser_error& ex) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to parse webhook payload: " << ex.what();
+                    return respond(400, "malformed JSON payload", m_keepAlive);
+                }
+
+                handle(event);
+            }
+
+            void bodyRead(const boost::system::error_code& error)
+            {
+                if (error) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Closing webhook connection in the middle of a request: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                readBody();
+            }
+
+            void handle(const boost::property_tree::ptree& event)
+            {
+                static const std::string BRANCH_PREFIX{ "refs/heads/" };
+
+                std::string ref = event.get<std::string>("ref", "");
+                if (ref.empty())
+                    return respond(200, "ignored, not a push event", m_keepAlive);
+
+                if (!boost::algorithm::starts_with(ref, BRANCH_PREFIX))
+                    return respond(200, "ignored, " + ref + " isn't a branch", m_keepAlive);
+
+                dsn::build_bot::Webhook::Push push;
+                push.branch = ref.substr(BRANCH_PREFIX.size());
+                push.revision = event.get<std::string>("after", "");
+                if (push.branch.empty() || push.revision.empty())
+                    return respond(400, "push event without branch or revision", m_keepAlive);
+
+                if (push.revision.find_first_not_of('0') == std::string::npos || event.get<std::string>("deleted", "") == "true")
+                    return respond(200, "ignored, " + push.branch + " was deleted", m_keepAlive);
+
+                // both end up in paths and git commands
+                if (push.revision.find_first_not_of("0123456789abcdef") != std::string::npos
+                    || std::any_of(push.branch.begin(), push.branch.end(), [](char c) { return c <= ' ' || c == 0x7f; })) {
+                    return respond(400, "invalid branch or revision", m_keepAlive);
+                }
+
+                // GitLab describes the repository in "project", the others in "repository"
+                for (auto section : { "repository", "project" }) {
+                    auto repository = event.get_child_optional(section);
+                    if (!repository)
+                        continue;
+
+                    for (auto& kv : *repository) {
+                        if (boost::algorithm::ends_with(kv.first, "url") && kv.second.empty() && !kv.second.data().empty())
+                            push.urls.push_back(kv.second.data());
+                    }
+                }
+
+                if (push.urls.empty())
+                    return respond(400, "push event without repository URL", m_keepAlive);
+
+                BOOST_LOG_SEV(log, severity::debug) << "Got push of " << push.revision << " to " << push.branch << " in " << push.urls.front();
+                auto self = shared_from_this();
+                m_handler(push, [self](const std::string& reply) {
+                    self->respond(boost::algorithm::starts_with(reply, "OK") ? 202 : 422, reply, self->m_keepAlive);
+                });
+            }
+
+            static const char* reason(int status)
+            {
+                switch (status) {
+                case 200:
+                    return "OK";
+                case 202:
+                    return "Accepted";
+                case 400:
+                    return "Bad Request";
+                case 405:
+                    return "Method Not Allowed";
+                case 411:
+                    return "Length Required";
+                case 413:
+                    return "Payload Too Large";
+                case 422:
+                    return "Unprocessable Entity";
+                case 431:
+                    return "Request Header Fields Too Large";
+                default:
+                    return "Unknown";
+                }
+            }
+
+            void respond(int status, const std::string& body, bool keepAlive)
+            {
+                m_keepAlive = keepAlive;
+
+                std::ostringstream response;
+                response << "HTTP/1.1 " << status << " " << reason(status) << "\r\n"
+                         << "Content-Type: text/plain\r\n"
+                         << "Content-Length: " << (body.size() + 1) << "\r\n";
+                if (!m_keepAlive)
+                    response << "Connection: close\r\n";
+                response << "\r\n"
+                         << body << "\n";
+
+                m_response = response.str();
+                boost::asio::async_write(m_socket, boost::asio::buffer(m_response),
+                    boost::bind(&WebhookSession::written, shared_from_this(), boost::asio::placeholders::error));
+            }
+
+            void written(const boost::system::error_code& error)
+            {
+                if (error) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to respond on webhook connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                if (m_keepAlive)
+                    return readRequest();
+
+                boost::system::error_code ignored;
+                m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                m_socket.close(ignored);
+            }
+
+        public:
+            WebhookSession(boost::asio::io_service& io, const dsn::build_bot::Webhook::Handler& handler,
+                           const dsn::build_bot::ControlSocket::Gate& gate, size_t max_body)
+                : m_socket(io)
+                , m_buffer(max_body + MAX_HEADER_LENGTH)
+                , m_handler(handler)
+                , m_gate(gate)
+                , m_maxBody(max_body)
+                , m_contentLength(0)
+                , m_keepAlive(false)
+            {
+            }
+
+            boost::asio::ip::tcp::socket& socket()
+            {
+                return m_socket;
+            }
+
+            void start()
+            {
+                readRequest();
+            }
+
+            static const size_t MAX_HEADER_LENGTH;
+        };
+
+        const size_t WebhookSession::MAX_HEADER_LENGTH{ 8192 };
+
+        class Webhook : public dsn::log::Base<Webhook> {
+        private:
+            boost::asio::io_service& m_io;
+            boost::asio::ip::tcp::acceptor m_acceptor;
+            dsn::build_bot::Webhook::Handler m_handler;
+            dsn::build_bot::ControlSocket::Gate m_gate;
+            size_t m_maxBody;
+
+            void accept()
+            {
+                auto session = std::make_shared<WebhookSession>(m_io, m_handler, m_gate, m_maxBody);
+                m_acceptor.async_accept(session->socket(), boost::bind(&Webhook::accepted, this, session, boost::asio::placeholders::error));
+            }
+
+            void accepted(std::shared_ptr<WebhookSession> session, const boost::system::error_code& error)
+            {
+                if (error) {
+                    if (error != boost::asio::error::operation_aborted)
+                        BOOST_LOG_SEV(log, severity::error) << "Failed to accept webhook connection: " << boost::system::system_error(error).what();
+                    return;
+                }
+
+                boost::system::error_code ignored;
+                BOOST_LOG_SEV(log, severity::trace) << "Accepted webhook connection from " << session->socket().remote_endpoint(ignored).address().to_string();
+                ::fcntl(session->socket().native_handle(), F_SETFD, FD_CLOEXEC);
+                session->start();
+                accept();
+            }
+
+        public:
+            Webhook(boost::asio::io_service& io, const dsn::build_bot::Webhook::Handler& handler,
+                    const dsn::build_bot::ControlSocket::Gate& gate, size_t max_body)
+                : m_io(io)
+                , m_acceptor(io)
+                , m_handler(handler)
+                , m_gate(gate)
+                , m_maxBody(max_body)
+            {
+            }
+
+            ~Webhook()
+            {
+                boost::system::error_code error;
+                m_acceptor.close(error);
+            }
+
+            bool listen(const std::string& address, unsigned short port)
+            {
+                try {
+                    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(address), port);
+                    m_acceptor.open(endpoint.protocol());
+                    ::fcntl(m_acceptor.native_handle(), F_SETFD, FD_CLOEXEC);
+
+                    // a restarted image binds again while connections of the old one linger
+                    m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+                    m_acceptor.bind(endpoint);
+                    m_acceptor.listen();
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to listen for webhooks on " << address << ":" << port << ": " << ex.what();
+                    return false;
+                }
+
+                BOOST_LOG_SEV(log, severity::info) << "Listening for webhooks on " << address << ":" << port;
+                accept();
+                return true;
+            }
+        };
+    }
+}
+}
+
+using namespace dsn::build_bot;
+
+Webhook::Webhook(boost::asio::io_service& io, const Handler& handler, const ControlSocket::Gate& gate, size_t max_body)
+    : m_impl(new priv::Webhook(io, handler, gate, max_body))
+{
+}
+
+Webhook::~Webhook()
+{
+}
+
+bool Webhook::listen(const std::string& address, unsigned short port)
+{
+    return m_impl->listen(address, port);
+}
@@ -1,15 +1,37 @@
 #include <build-bot/worker.h>
+#include <build-bot/recovery.h>
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/random/random_device.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
+#include <boost/uuid/detail/sha1.hpp>
 
 #include <boost/process.hpp>
 
-#include <dsnutil/finally.h>
 #include <dsnutil/pretty_print.h>
 
 namespace fs = boost::filesystem;
@@ -17,6 +39,83 @@ namespace fs = boost::filesystem;
 namespace dsn {
 namespace build_bot {
     namespace priv {
+        /// Build configuration of a repository with the commands of its profiles compiled
+        struct BuildConfig {
+            struct Profile {
+                std::string name;
+
+                /// Unset if the profile doesn't have the command
+                boost::optional<dsn::build_bot::MacroTemplate> configure;
+                boost::optional<dsn::build_bot::MacroTemplate> build;
+            };
+
+            /// Profiles in the order of the file
+            std::vector<Profile> profiles;
+
+            const Profile* find(const std::string& name) const
+            {
+                for (auto& profile : profiles) {
+                    if (profile.name == name)
+                        return &profile;
+                }
+
+                return nullptr;
+            }
+        };
+
+        /// Build configurations by the git blob ID of the file they were parsed from, shared
+        /// by all workers. The ID names the contents, so entries never go stale; the oldest
+        /// ones are dropped once there are CAPACITY of them.
+        class BuildConfigCache {
+        private:
+            std::mutex m_mutex;
+            std::map<std::string, std::shared_ptr<const BuildConfig> > m_configs;
+            std::deque<std::string> m_order;
+
+        public:
+            static const size_t CAPACITY;
+
+            /// Same as "git hash-object": SHA-1 of "blob <size>\0" followed by the contents
+            static std::string blobId(const std::string& contents)
+            {
+                std::string header = "blob " + std::to_string(contents.size());
+                boost::uuids::detail::sha1 sha1;
+                sha1.process_bytes(header.data(), header.size() + 1);
+                sha1.process_bytes(contents.data(), contents.size());
+
+                boost::uuids::detail::sha1::digest_type digest;
+                sha1.get_digest(digest);
+
+                std::ostringstream res;
+                res << std::hex << std::setfill('0');
+                for (auto word : digest)
+                    res << std::setw(8) << word;
+                return res.str();
+            }
+
+            std::shared_ptr<const BuildConfig> find(const std::string& blob)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_configs.find(blob);
+                return (it == m_configs.end() ? nullptr : it->second);
+            }
+
+            void insert(const std::string& blob, const std::shared_ptr<const BuildConfig>& config)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_configs.emplace(blob, config).second)
+                    return;
+
+                m_order.push_back(blob);
+                if (m_order.size() > CAPACITY) {
+                    m_configs.erase(m_order.front());
+                    m_order.pop_front();
+                }
+            }
+        };
+
+        const size_t BuildConfigCache::CAPACITY{ 256 };
+
         class Worker : public dsn::log::Base<Worker> {
         private:
             std::string m_url;
@@ -26,7 +125,7 @@ namespace build_bot {
             std::string m_profileName;
             std::string m_buildDir;
             std::string m_repoName;
-            std::string m_macroFile;
+            std::vector<int> m_cpus;
 
             std::string generateBuildId()
             {
@@ -70,6 +169,188 @@ namespace build_bot {
                 return true;
             }
 
+            /// Number of workers sharing the checkout in m_toplevelDirectory; the last one to
+            /// clean up removes it
+            std::shared_ptr<std::atomic<size_t> > m_checkoutUsers;
+
+            long m_peakMemory;
+
+            /// Calls visit(path, rss) for every process in the given process group, with
+            /// its /proc directory and resident set size in pages
+            template <typename Visitor>
+            static void forEachInGroup(pid_t pgid, Visitor visit)
+            {
+                boost::system::error_code error;
+                for (fs::directory_iterator it("/proc", error), end; !error && it != end; it.increment(error)) {
+                    const std::string pid = it->path().filename().string();
+                    if (pid.find_first_not_of("0123456789") != std::string::npos)
+                        continue;
+
+                    std::ifstream stat(it->path().string() + "/stat");
+                    std::string line;
+                    if (!std::getline(stat, line))
+                        continue;
+
+                    // the command name may contain spaces, so fields are counted after its closing paren
+                    size_t pos = line.rfind(')');
+                    if (pos == std::string::npos)
+                        continue;
+
+                    std::istringstream fields(line.substr(pos + 1));
+                    std::string field;
+                    pid_t group{ 0 };
+                    long rss{ 0 };
+                    for (int i = 3; i <= 24 && (fields >> field); i++) {
+                        if (i == 5)
+                            group = std::atol(field.c_str());
+                        else if (i == 24)
+                            rss = std::atol(field.c_str());
+                    }
+
+                    if (group == pgid)
+                        visit(it->path(), rss);
+                }
+            }
+
+            /// Sums the resident set size (in KiB) of all processes in the given process group
+            static long processGroupMemory(pid_t pgid)
+            {
+                static const long pageSize = sysconf(_SC_PAGESIZE) / 1024;
+
+                long res{ 0 };
+                forEachInGroup(pgid, [&res](const fs::path&, long rss) { res += rss * pageSize; });
+                return res;
+            }
+
+            /// Moves every thread of the given process group to the given CPUs; processes
+            /// and threads which exit meanwhile are skipped
+            static void pinProcessGroup(pid_t pgid, const std::vector<int>& cpus)
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (auto cpu : cpus)
+                    CPU_SET(cpu, &set);
+
+                forEachInGroup(pgid, [&set](const fs::path& process, long) {
+                    boost::system::error_code error;
+                    for (fs::directory_iterator it(process / "task", error), end; !error && it != end; it.increment(error))
+                        ::sched_setaffinity(std::atoi(it->path().filename().string().c_str()), sizeof(set), &set);
+                });
+            }
+
+            /// Like boost::process::wait_for_exit() but also records the peak memory usage
+            /// of the child's process group. The summed RSS of the whole group is sampled
+            /// while the child is running, since the ru_maxrss reported by wait4() is only
+            /// the peak of the largest single process.
+            int waitForExit(const boost::process::child& child)
+            {
+                // the child calls setpgid() itself, this closes the race until it gets there
+                ::setpgid(child.pid, child.pid);
+                {
+                    std::lock_guard<std::mutex> lock(m_childMutex);
+                    m_childGroup = child.pid;
+
+                    // the CPUs may have been rebalanced since the child was started
+                    if (!m_cpus.empty())
+                        pinProcessGroup(m_childGroup, m_cpus);
+
+                    if (m_terminated)
+                        ::kill(-m_childGroup, SIGKILL);
+                    else if (m_suspended)
+                        ::kill(-m_childGroup, SIGSTOP);
+                }
+
+                // lets the next start find the group if the bot dies before it exits
+                if (!dsn::build_bot::Recovery::registerChild(m_buildDir, child.pid, m_toplevelDirectory))
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to register process group " << child.pid << " in " << m_buildDir;
+
+                std::mutex mutex;
+                std::condition_variable cond;
+                bool exited{ false };
+                std::thread sampler([&]() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!exited) {
+                        lock.unlock();
+                        long used = processGroupMemory(child.pid);
+                        lock.lock();
+                        m_peakMemory = std::max(m_peakMemory, used);
+                        cond.wait_for(lock, MEMORY_SAMPLE_INTERVAL, [&]() { return exited; });
+                    }
+                });
+
+                // the child is only reaped once it isn't held for a handover anymore; the
+                // group is reported as running until then, so it is either handed over or gone
+                siginfo_t info;
+                while (::waitid(P_PID, child.pid, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+                }
+
+                int status{ 0 };
+                struct rusage usage;
+                pid_t ret;
+                int waitError;
+                {
+                    std::unique_lock<std::mutex> lock(m_childMutex);
+                    m_reapable.wait(lock, [&]() { return !m_held; });
+
+                    do {
+                        ret = ::wait4(child.pid, &status, 0, &usage);
+                    } while (ret == -1 && errno == EINTR);
+                    waitError = errno;
+                    m_childGroup = 0;
+                }
+                dsn::build_bot::Recovery::unregisterChild(m_buildDir, child.pid);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    exited = true;
+                }
+                cond.notify_all();
+                sampler.join();
+
+                if (ret == -1)
+                    throw boost::system::system_error(boost::system::error_code(waitError, boost::system::system_category()), "wait4(2) failed");
+
+                m_peakMemory = std::max(m_peakMemory, usage.ru_maxrss);
+                return status;
+            }
+
+            static const std::chrono::milliseconds MEMORY_SAMPLE_INTERVAL;
+
+            /// Process group of the currently running child (0 if there is none) and
+            /// whether it has to be kept stopped for a preempting job
+            mutable std::mutex m_childMutex;
+            pid_t m_childGroup;
+            bool m_suspended;
+            bool m_terminated;
+
+            /// Set while exited children are left for the next process image to reap
+            bool m_held;
+            std::condition_variable m_reapable;
+
+            /// Child started by the previous process image before a RESTART handover
+            pid_t m_adoptedChild;
+
+            /// Waits for the adopted child instead of starting the stage's command. Returns
+            /// false if the child can't be waited for (e.g. it was reaped by the previous
+            /// image already), in which case the stage has to be run again.
+            bool waitForAdopted(bool& success)
+            {
+                pid_t pid = m_adoptedChild;
+                m_adoptedChild = 0;
+
+                BOOST_LOG_SEV(log, severity::info) << "Waiting for adopted process group " << pid << " in " << m_binaryDir;
+                try {
+                    success = (waitForExit(boost::process::child(pid)) == 0);
+                }
+
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::warning) << "Lost track of adopted process group " << pid << ": " << ex.what() << "; running stage again";
+                    return false;
+                }
+
+                return true;
+            }
+
             std::string m_gitExecutable;
             bool findGitExecutable()
             {
@@ -103,8 +384,9 @@ namespace build_bot {
                     BOOST_LOG_SEV(log, severity::debug) << "Git command line is " << args;
 
                     boost::process::child child = boost::process::execute(boost::process::initializers::run_exe(m_gitExecutable),
-                                                                          boost::process::initializers::set_cmd_line(args));
-                    auto exit_code = boost::process::wait_for_exit(child);
+                                                                          boost::process::initializers::set_cmd_line(args),
+                                                                          boost::process::initializers::set_process_group());
+                    auto exit_code = waitForExit(child);
 
                     if (exit_code != 0) {
                         BOOST_LOG_SEV(log, severity::error) << "Got non-zero exit status from '" << args << "': " << exit_code;
@@ -126,8 +408,9 @@ namespace build_bot {
                     BOOST_LOG_SEV(log, severity::debug) << "Git command line is " << args;
                     boost::process::child child = boost::process::execute(boost::process::initializers::run_exe(m_gitExecutable),
                                                                           boost::process::initializers::set_cmd_line(args),
-                                                                          boost::process::initializers::start_in_dir(m_sourceDirectory));
-                    auto exit_code = boost::process::wait_for_exit(child);
+                                                                          boost::process::initializers::start_in_dir(m_sourceDirectory),
+                                                                          boost::process::initializers::set_process_group());
+                    auto exit_code = waitForExit(child);
                     if (exit_code != 0) {
                         BOOST_LOG_SEV(log, severity::error) << "Got non-zero exit status from '" << args << "': " << exit_code;
                         return false;
@@ -141,38 +424,20 @@ namespace build_bot {
 
                 BOOST_LOG_SEV(log, severity::info) << "Checked out revision " << m_revision;
 
-                m_macros.put<std::string>("CMAKE_SOURCE_DIRECTORY", m_sourceDirectory);
+                m_macros.set("CMAKE_SOURCE_DIRECTORY", m_sourceDirectory);
 
                 return true;
             }
 
-            boost::property_tree::ptree m_macros;
-            bool loadMacroFile()
-            {
-                fs::path path(m_macroFile);
-                if (!fs::exists(path)) {
-                    BOOST_LOG_SEV(log, severity::warning) << "Macro file " << m_macroFile << " doesn't exist!";
-                    return true;
-                }
+            /// Macros of the configuration snapshot the worker was created with
+            dsn::build_bot::MacroScope m_macros;
 
-                if (!fs::is_regular_file(path)) {
-                    BOOST_LOG_SEV(log, severity::error) << "Macro configuration " << m_macroFile << " exists but isn't a regular file!";
-                    return false;
-                }
+            /// Shared with the workers split off this one
+            std::shared_ptr<const BuildConfig> m_buildConfig;
+            static BuildConfigCache s_buildConfigs;
 
-                try {
-                    boost::property_tree::read_ini(m_macroFile, m_macros);
-                }
-
-                catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to parse macros from " << m_macroFile << ": " << ex.what();
-                    return false;
-                }
-
-                return true;
-            }
-
-            boost::property_tree::ptree m_buildSettings;
+            /// Parses the build configuration unless one with the same blob ID has been
+            /// parsed before
             bool loadBuildConfig()
             {
                 std::string configFile = m_sourceDirectory + "/" + m_configFile;
@@ -187,8 +452,25 @@ namespace build_bot {
                     return false;
                 }
 
+                std::ifstream file(configFile, std::ios::binary);
+                std::ostringstream contents;
+                contents << file.rdbuf();
+                if (!file) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to read build configuration from " << configFile;
+                    return false;
+                }
+
+                std::string blob = BuildConfigCache::blobId(contents.str());
+                m_buildConfig = s_buildConfigs.find(blob);
+                if (m_buildConfig) {
+                    BOOST_LOG_SEV(log, severity::debug) << "Using cached build configuration " << blob << " of " << m_configFile;
+                    return true;
+                }
+
+                boost::property_tree::ptree settings;
                 try {
-                    boost::property_tree::read_ini(configFile, m_buildSettings);
+                    std::istringstream stream(contents.str());
+                    boost::property_tree::read_ini(stream, settings);
                 }
 
                 catch (boost::property_tree::ini_parser_error& ex) {
@@ -196,6 +478,22 @@ namespace build_bot {
                     return false;
                 }
 
+                std::shared_ptr<BuildConfig> config = std::make_shared<BuildConfig>();
+                for (auto& kv : settings) {
+                    if (kv.second.empty())
+                        continue;
+
+                    BuildConfig::Profile profile;
+                    profile.name = kv.first;
+                    if (auto command = kv.second.get_optional<std::string>("cmd_configure"))
+                        profile.configure = dsn::build_bot::MacroTemplate(*command);
+                    if (auto command = kv.second.get_optional<std::string>("cmd_build"))
+                        profile.build = dsn::build_bot::MacroTemplate(*command);
+                    config->profiles.push_back(profile);
+                }
+
+                s_buildConfigs.insert(blob, config);
+                m_buildConfig = config;
                 return true;
             }
 
@@ -219,46 +517,34 @@ namespace build_bot {
                 return true;
             }
 
-            bool replaceMacros(std::string& str)
+            bool expandMacros(const dsn::build_bot::MacroTemplate& command, std::string& res)
             {
-                for (auto& kv : m_macros) {
-                    try {
-                        std::string key = kv.first;
-                        std::string val = m_macros.get<std::string>(key);
-                        std::string token = "@" + key + "@";
-                        boost::algorithm::replace_all(str, token, val);
-                    }
-
-                    catch (boost::property_tree::ptree_error& ex) {
-                        BOOST_LOG_SEV(log, severity::error) << "Failed to replace macro: " << ex.what();
-                        return false;
-                    }
-                }
+                std::vector<std::string> undefined;
+                if (command.expand(m_macros, res, undefined))
+                    return true;
 
-                return true;
+                BOOST_LOG_SEV(log, severity::error) << "Undefined macro(s) in command " << command.text() << ": " << boost::algorithm::join(undefined, ", ");
+                return false;
             }
 
             bool configureSources()
             {
                 BOOST_LOG_SEV(log, severity::info) << "Trying to configure sources";
-                std::string configureCommand;
-                try {
-                    configureCommand = m_buildSettings.get<std::string>(m_profileName + ".cmd_configure");
-                }
-
-                catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to get configure command from build settings: " << ex.what();
+                const BuildConfig::Profile* profile = m_buildConfig->find(m_profileName);
+                if (!profile || !profile->configure) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to get configure command from build settings: no cmd_configure in profile " << m_profileName;
                     return false;
                 }
 
-                if (configureCommand.size() == 0) {
+                if (profile->configure->text().size() == 0) {
                     BOOST_LOG_SEV(log, severity::warning) << "Configure command is empty; continuing build!";
                     return true;
                 }
 
-                BOOST_LOG_SEV(log, severity::debug) << "Configure command is: " << configureCommand;
+                BOOST_LOG_SEV(log, severity::debug) << "Configure command is: " << profile->configure->text();
 
-                if (!replaceMacros(configureCommand)) {
+                std::string configureCommand;
+                if (!expandMacros(*profile->configure, configureCommand)) {
                     BOOST_LOG_SEV(log, severity::error) << "Macro expansion failed for configure command!";
                     return false;
                 }
@@ -288,8 +574,10 @@ namespace build_bot {
                     boost::process::child child = boost::process::execute(boost::process::initializers::run_exe(executable),
                                                                           boost::process::initializers::set_cmd_line(configureCommand),
                                                                           boost::process::initializers::start_in_dir(m_binaryDir),
+                                                                          boost::process::initializers::set_cpu_affinity(cpus()),
+                                                                          boost::process::initializers::set_process_group(),
                                                                           boost::process::initializers::inherit_env());
-                    auto exit_code = boost::process::wait_for_exit(child);
+                    auto exit_code = waitForExit(child);
                     if (exit_code != 0) {
                         BOOST_LOG_SEV(log, severity::error) << "Configure command " << configureCommand << " returned non-zero exit status!";
                         return false;
@@ -308,23 +596,21 @@ namespace build_bot {
             bool build()
             {
                 BOOST_LOG_SEV(log, severity::info) << "Starting actual build for " << m_binaryDir;
-                std::string buildCommand;
-                try {
-                    buildCommand = m_buildSettings.get<std::string>(m_profileName + ".cmd_build");
-                }
-                catch (boost::property_tree::ptree_error& ex) {
-                    BOOST_LOG_SEV(log, severity::error) << "Unable to get build command from configuration: " << ex.what();
+                const BuildConfig::Profile* profile = m_buildConfig->find(m_profileName);
+                if (!profile || !profile->build) {
+                    BOOST_LOG_SEV(log, severity::error) << "Unable to get build command from configuration: no cmd_build in profile " << m_profileName;
                     return false;
                 }
 
-                if (buildCommand.size() == 0) {
+                if (profile->build->text().size() == 0) {
                     BOOST_LOG_SEV(log, severity::warning) << "Build command is empty; skipping!";
                     return true;
                 }
 
-                BOOST_LOG_SEV(log, severity::debug) << "Build command is " << buildCommand;
+                BOOST_LOG_SEV(log, severity::debug) << "Build command is " << profile->build->text();
 
-                if (!replaceMacros(buildCommand)) {
+                std::string buildCommand;
+                if (!expandMacros(*profile->build, buildCommand)) {
                     BOOST_LOG_SEV(log, severity::error) << "Macro expansion failed for build command!";
                     return false;
                 }
@@ -355,8 +641,10 @@ namespace build_bot {
                     boost::process::child child = boost::process::execute(boost::process::initializers::run_exe(executable),
                                                                           boost::process::initializers::set_cmd_line(buildCommand),
                                                                           boost::process::initializers::start_in_dir(m_binaryDir),
+                                                                          boost::process::initializers::set_cpu_affinity(cpus()),
+                                                                          boost::process::initializers::set_process_group(),
                                                                           boost::process::initializers::inherit_env());
-                    auto exit_code = boost::process::wait_for_exit(child);
+                    auto exit_code = waitForExit(child);
                     if (exit_code != 0) {
                         BOOST_LOG_SEV(log, severity::error) << "Build command " << buildCommand << " returned non-zero exit status!";
                         return false;
@@ -374,26 +662,141 @@ namespace build_bot {
             }
 
         public:
-            Worker(const std::string& macro_file, const std::string& build_directory,
+            Worker(const std::shared_ptr<const dsn::build_bot::MacroTable>& macros, const std::string& build_directory,
                    const std::string& repo_name,
                    const std::string& url, const std::string& branch, const std::string& revision,
                    const std::string& config_file, const std::string& profile_name)
                 : m_buildDir(build_directory)
-                , m_macroFile(macro_file)
+                , m_macros(macros)
                 , m_url(url)
                 , m_branch(branch)
                 , m_revision(revision)
                 , m_configFile(config_file)
                 , m_profileName(profile_name)
                 , m_repoName(repo_name)
+                , m_checkoutUsers(std::make_shared<std::atomic<size_t> >(1))
+                , m_peakMemory(0)
+                , m_childGroup(0)
+                , m_suspended(false)
+                , m_terminated(false)
+                , m_held(false)
+                , m_adoptedChild(0)
             {
             }
 
-            void run()
+            const std::string& profile() const
+            {
+                return m_profileName;
+            }
+
+            long peakMemory() const
+            {
+                return m_peakMemory;
+            }
+
+            /// Also moves the running child's process group, the CPUs may be rebalanced at any time
+            void setCpuAffinity(const std::vector<int>& cpus)
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                m_cpus = cpus;
+                if (m_childGroup > 0 && !m_cpus.empty())
+                    pinProcessGroup(m_childGroup, m_cpus);
+            }
+
+            std::vector<int> cpus() const
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                return m_cpus;
+            }
+
+            const std::string& workspace() const
+            {
+                return m_toplevelDirectory;
+            }
+
+            const std::string& binaryDirectory() const
+            {
+                return m_binaryDir;
+            }
+
+            pid_t childGroup() const
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                return m_childGroup;
+            }
+
+            void terminate()
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                m_terminated = true;
+                if (m_childGroup > 0 && ::kill(-m_childGroup, SIGKILL) == -1)
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to kill process group " << m_childGroup << ": " << strerror(errno);
+            }
+
+            void hold(bool held)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_childMutex);
+                    m_held = held;
+                }
+                m_reapable.notify_all();
+            }
+
+            /// Takes over a workspace checked out by the previous process image, optionally
+            /// together with the process group running the current stage
+            bool adopt(const std::string& workspace, const std::string& binary_dir, pid_t child_group)
+            {
+                if (!findGitExecutable())
+                    return false;
+
+                m_toplevelDirectory = workspace;
+                m_buildId = fs::path(workspace).filename().string();
+                m_sourceDirectory = m_toplevelDirectory + "/repo";
+                m_binaryDir = binary_dir;
+
+                BOOST_LOG_SEV(log, severity::info) << "Adopting workspace " << m_toplevelDirectory << " for repo " << m_repoName
+                                                   << " (profile: " << m_profileName << ") - Build ID: " << m_buildId;
+                if (!fs::is_directory(m_sourceDirectory) || !fs::is_directory(m_binaryDir)) {
+                    BOOST_LOG_SEV(log, severity::error) << "Workspace " << m_toplevelDirectory << " is incomplete!";
+                    return false;
+                }
+
+                if (!loadBuildConfig())
+                    return false;
+
+                m_macros.set("CMAKE_SOURCE_DIRECTORY", m_sourceDirectory);
+                m_adoptedChild = child_group;
+
+                return true;
+            }
+
+            void shareCheckout(const Worker& other)
+            {
+                m_checkoutUsers = other.m_checkoutUsers;
+                ++*m_checkoutUsers;
+            }
+
+            void suspend()
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                m_suspended = true;
+                if (m_childGroup > 0 && ::kill(-m_childGroup, SIGSTOP) == -1)
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to stop process group " << m_childGroup << ": " << strerror(errno);
+            }
+
+            void resume()
+            {
+                std::lock_guard<std::mutex> lock(m_childMutex);
+                m_suspended = false;
+                if (m_childGroup > 0 && ::kill(-m_childGroup, SIGCONT) == -1)
+                    BOOST_LOG_SEV(log, severity::warning) << "Failed to continue process group " << m_childGroup << ": " << strerror(errno);
+            }
+
+            bool acquire()
             {
                 if (!findGitExecutable()) {
                     BOOST_LOG_SEV(log, severity::error) << "Failed to find git; build FAILED!";
-                    return;
+                    return false;
                 }
 
                 m_buildId = generateBuildId();
@@ -401,67 +804,186 @@ namespace build_bot {
                                                    << " (profile: " << m_profileName << ", config: " << m_configFile << ") - Build ID: " << m_buildId;
                 if (!initToplevelDirectory()) {
                     BOOST_LOG_SEV(log, severity::error) << "Unable to create build directory; build FAILED!";
-                    return;
-                }
-
-                dsn::finally finally_delete_toplevel_dir([&]() {
-		    BOOST_LOG_SEV(log , severity::info) << "Removing build directory: " << m_toplevelDirectory;
-		    try {
-		      fs::path path(m_toplevelDirectory);
-		      fs::remove_all(path);
-		    }
-		    catch(boost::system::system_error& ex) {
-		      BOOST_LOG_SEV(log,severity::error) << "Failed to remove build directory: " << ex.what();
-		    }
-                });
-
-                if (!loadMacroFile()) {
-                    BOOST_LOG_SEV(log, severity::error) << "Failed to load macro file; build FAILED!";
-                    return;
+                    return false;
                 }
 
                 if (!checkoutSources()) {
                     BOOST_LOG_SEV(log, severity::error) << "Failed to checkout sources from " << m_url << "; build FAILED!";
-                    return;
+                    return false;
                 }
 
-                if (!createBinaryDir()) {
+                // every profile of a matrix build gets its own binary dir when it's split off
+                if (m_profileName != dsn::build_bot::Worker::ALL_PROFILES && !createBinaryDir()) {
                     BOOST_LOG_SEV(log, severity::error) << "Failed to create build directory; build FAILED!";
-                    return;
+                    return false;
                 }
 
                 if (!loadBuildConfig()) {
                     BOOST_LOG_SEV(log, severity::error) << "Failed to load build configuration; build FAILED!";
-                    return;
+                    return false;
+                }
+
+                return true;
+            }
+
+            bool configure()
+            {
+                bool success{ false };
+                if (m_adoptedChild > 0 && waitForAdopted(success)) {
+                    if (!success)
+                        BOOST_LOG_SEV(log, severity::error) << "Adopted configure command returned non-zero exit status; build FAILED!";
+                    return success;
                 }
 
                 if (!configureSources()) {
                     BOOST_LOG_SEV(log, severity::error) << "Configure step aborted; build FAILED!";
-                    return;
+                    return false;
+                }
+
+                return true;
+            }
+
+            bool runBuild()
+            {
+                // the estimate is for the build command alone, without the configure step
+                m_peakMemory = 0;
+
+                bool success{ false };
+                if (m_adoptedChild > 0 && waitForAdopted(success)) {
+                    if (!success) {
+                        BOOST_LOG_SEV(log, severity::error) << "Adopted build command returned non-zero exit status; build FAILED!";
+                        return false;
+                    }
+
+                    BOOST_LOG_SEV(log, severity::info) << "All steps finished; build SUCCESSFUL!";
+                    return true;
                 }
 
                 if (!build()) {
                     BOOST_LOG_SEV(log, severity::error) << "Build step aborted; build FAILED!";
-                    return;
+                    return false;
                 }
 
                 BOOST_LOG_SEV(log, severity::info) << "All steps finished; build SUCCESSFUL!";
+                return true;
+            }
+
+            /// Profiles (sections) defined in the repository's build configuration
+            std::vector<std::string> profiles() const
+            {
+                std::vector<std::string> res;
+                for (auto& profile : m_buildConfig->profiles)
+                    res.push_back(profile.name);
+
+                return res;
+            }
+
+            /// Takes over the checkout of a matrix build for one of its profiles
+            Worker(const Worker& parent, const std::string& profile_name)
+                : m_url(parent.m_url)
+                , m_branch(parent.m_branch)
+                , m_revision(parent.m_revision)
+                , m_configFile(parent.m_configFile)
+                , m_profileName(profile_name)
+                , m_buildDir(parent.m_buildDir)
+                , m_repoName(parent.m_repoName)
+                , m_buildId(parent.m_buildId)
+                , m_toplevelDirectory(parent.m_toplevelDirectory)
+                , m_checkoutUsers(parent.m_checkoutUsers)
+                , m_peakMemory(0)
+                , m_childGroup(0)
+                , m_suspended(false)
+                , m_terminated(false)
+                , m_held(false)
+                , m_adoptedChild(0)
+                , m_gitExecutable(parent.m_gitExecutable)
+                , m_sourceDirectory(parent.m_sourceDirectory)
+                , m_macros(parent.m_macros)
+                , m_buildConfig(parent.m_buildConfig)
+            {
+            }
+
+            /// Binary dir of a profile split off a matrix build; the shared source tree is left alone
+            bool prepareProfile()
+            {
+                m_binaryDir = m_toplevelDirectory + "/build-" + m_profileName;
+                fs::path path(m_binaryDir);
+
+                BOOST_LOG_SEV(log, severity::info) << "Creating binary dir for profile " << m_profileName << ": " << m_binaryDir;
+                try {
+                    fs::create_directories(path);
+                }
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to create binary dir " << m_binaryDir << ": " << ex.what();
+                    return false;
+                }
+
+                return true;
+            }
+
+            void cleanup()
+            {
+                if (m_toplevelDirectory.empty())
+                    return;
+
+                // other profiles may still be building from the same checkout
+                std::string path = m_toplevelDirectory;
+                if (--*m_checkoutUsers > 0)
+                    path = m_binaryDir;
+
+                if (path.empty())
+                    return;
+
+                BOOST_LOG_SEV(log, severity::info) << "Removing build directory: " << path;
+                try {
+                    fs::remove_all(fs::path(path));
+                }
+                catch (boost::system::system_error& ex) {
+                    BOOST_LOG_SEV(log, severity::error) << "Failed to remove build directory: " << ex.what();
+                }
+            }
+
+            /// Creates one worker per profile of the build configuration, all sharing this
+            /// worker's checkout. This worker must not be used afterwards.
+            std::vector<std::unique_ptr<Worker> > split()
+            {
+                std::vector<std::unique_ptr<Worker> > res;
+                for (auto& profile : profiles()) {
+                    std::unique_ptr<Worker> worker(new Worker(*this, profile));
+                    if (!worker->prepareProfile())
+                        continue;
+                    res.push_back(std::move(worker));
+                }
+
+                // without any profile the checkout is still ours to clean up
+                if (!res.empty())
+                    *m_checkoutUsers = res.size();
+                return res;
             }
         };
 
         const std::string Worker::BUILD_ID_CHARS{ "0123456789abcdef" };
         const size_t Worker::BUILD_ID_LENGTH{ 8 };
+        const std::chrono::milliseconds Worker::MEMORY_SAMPLE_INTERVAL{ 500 };
+        BuildConfigCache Worker::s_buildConfigs;
     }
 }
 }
 
 using namespace dsn::build_bot;
 
-Worker::Worker(const std::string& macro_file, const std::string& build_directory,
+const std::string Worker::ALL_PROFILES{ "all" };
+
+Worker::Worker(const std::shared_ptr<const MacroTable>& macros, const std::string& build_directory,
                const std::string& repo_name,
                const std::string& url, const std::string& branch, const std::string& revision,
                const std::string& config_file, const std::string& profile_name)
-    : m_impl(new priv::Worker(macro_file, build_directory, repo_name, url, branch, revision, config_file, profile_name))
+    : m_impl(new priv::Worker(macros, build_directory, repo_name, url, branch, revision, config_file, profile_name))
+{
+}
+
+Worker::Worker(std::unique_ptr<priv::Worker> impl)
+    : m_impl(std::move(impl))
 {
 }
 
@@ -469,7 +991,91 @@ Worker::~Worker()
 {
 }
 
-void Worker::run()
+const std::string& Worker::profile() const
+{
+    return m_impl->profile();
+}
+
+std::vector<std::shared_ptr<Worker> > Worker::split()
+{
+    std::vector<std::shared_ptr<Worker> > res;
+    for (auto& impl : m_impl->split())
+        res.push_back(std::shared_ptr<Worker>(new Worker(std::move(impl))));
+
+    return res;
+}
+
+void Worker::setCpuAffinity(const std::vector<int>& cpus)
+{
+    return m_impl->setCpuAffinity(cpus);
+}
+
+long Worker::peakMemory() const
+{
+    return m_impl->peakMemory();
+}
+
+const std::string& Worker::workspace() const
+{
+    return m_impl->workspace();
+}
+
+const std::string& Worker::binaryDirectory() const
+{
+    return m_impl->binaryDirectory();
+}
+
+int Worker::childGroup() const
+{
+    return m_impl->childGroup();
+}
+
+void Worker::terminate()
+{
+    return m_impl->terminate();
+}
+
+void Worker::hold(bool held)
+{
+    return m_impl->hold(held);
+}
+
+bool Worker::adopt(const std::string& workspace, const std::string& binary_dir, int child_group)
+{
+    return m_impl->adopt(workspace, binary_dir, child_group);
+}
+
+void Worker::shareCheckout(const Worker& other)
+{
+    return m_impl->shareCheckout(*other.m_impl);
+}
+
+void Worker::suspend()
+{
+    return m_impl->suspend();
+}
+
+void Worker::resume()
+{
+    return m_impl->resume();
+}
+
+bool Worker::acquire()
+{
+    return m_impl->acquire();
+}
+
+bool Worker::configure()
+{
+    return m_impl->configure();
+}
+
+bool Worker::build()
+{
+    return m_impl->runBuild();
+}
+
+void Worker::cleanup()
 {
-    return m_impl->run();
+    return m_impl->cleanup();
 }